@@ -0,0 +1,301 @@
+/*
+ * LD_PRELOAD shim that delays metadata calls, so that du-sync can be measured
+ * on a local tree as if it lived on a network filesystem:
+ *
+ *   LD_PRELOAD=bench/latency_shim.so LATSHIM_US=1000 ./du-sync -j 16 DIR
+ *
+ * Environment (latencies in microseconds, all optional):
+ *   LATSHIM_US             mean delay of every wrapped call (default 0)
+ *   LATSHIM_STAT_US        lstat, stat, fstatat, statx (default: LATSHIM_US)
+ *   LATSHIM_OPENDIR_US     opendir, fdopendir, openat with O_DIRECTORY (default: LATSHIM_US)
+ *   LATSHIM_READDIR_US     one READDIR round trip (default: LATSHIM_US)
+ *   LATSHIM_READDIR_BATCH  readdir calls served per round trip (default: 32)
+ *   LATSHIM_DIST           fixed (default), uniform (0 .. 2 x mean), exp or lognormal
+ *   LATSHIM_SIGMA          lognormal shape (default: 1); the mean stays as given
+ *   LATSHIM_JITTER_US      uniform extra delay 0 .. JITTER added to every delayed call
+ *   LATSHIM_SEED           random seed (default: 1)
+ *   LATSHIM_REPORT         if set, print call counts and total delay to stderr at exit
+ *
+ * A delay blocks the calling thread, as a round trip would, with the timer slack
+ * lowered to 1ns so that short delays are not rounded up to the default 50us.
+ * Readdir batches are counted per thread, which matches du-sync (a directory is
+ * read by one thread) closely enough.
+ */
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <time.h>
+
+enum { OP_STAT = 0, OP_OPENDIR, OP_READDIR, OP_COUNT };
+
+static const char *const op_names[OP_COUNT] = {"stat", "opendir", "readdir"};
+
+typedef enum Dist {
+    DIST_FIXED = 0,
+    DIST_UNIFORM,
+    DIST_EXP,
+    DIST_LOGNORMAL,
+} Dist;
+
+static struct {
+    atomic_int ready;
+    double mean_us[OP_COUNT];
+    double jitter_us;
+    double sigma;
+    Dist dist;
+    uint64_t readdir_batch;
+    uint64_t seed;
+    int report;
+} cfg;
+
+static atomic_uint_fast64_t calls[OP_COUNT];
+static atomic_uint_fast64_t delayed[OP_COUNT];
+static atomic_uint_fast64_t delay_ns[OP_COUNT];
+static atomic_uint_fast64_t thread_seq;
+
+static _Thread_local uint64_t rng_state;
+static _Thread_local int slack_set;
+static _Thread_local uint64_t readdir_left; /* calls until the next round trip */
+
+static double env_double(const char *name, double def) {
+    const char *s = getenv(name);
+    if (!s || !*s) return def;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    return (end && *end == '\0' && v >= 0.0) ? v : def;
+}
+
+static void load_config(void) {
+    if (atomic_load_explicit(&cfg.ready, memory_order_acquire)) return;
+
+    double all = env_double("LATSHIM_US", 0.0);
+    cfg.mean_us[OP_STAT] = env_double("LATSHIM_STAT_US", all);
+    cfg.mean_us[OP_OPENDIR] = env_double("LATSHIM_OPENDIR_US", all);
+    cfg.mean_us[OP_READDIR] = env_double("LATSHIM_READDIR_US", all);
+    cfg.jitter_us = env_double("LATSHIM_JITTER_US", 0.0);
+    cfg.sigma = env_double("LATSHIM_SIGMA", 1.0);
+    double batch = env_double("LATSHIM_READDIR_BATCH", 32.0);
+    cfg.readdir_batch = batch >= 1.0 ? (uint64_t)batch : 1;
+    cfg.seed = (uint64_t)env_double("LATSHIM_SEED", 1.0);
+    cfg.report = getenv("LATSHIM_REPORT") != NULL;
+
+    const char *d = getenv("LATSHIM_DIST");
+    if (d && strcmp(d, "uniform") == 0) cfg.dist = DIST_UNIFORM;
+    else if (d && strcmp(d, "exp") == 0) cfg.dist = DIST_EXP;
+    else if (d && strcmp(d, "lognormal") == 0) cfg.dist = DIST_LOGNORMAL;
+    else cfg.dist = DIST_FIXED;
+
+    atomic_store_explicit(&cfg.ready, 1, memory_order_release);
+}
+
+__attribute__((constructor)) static void shim_init(void) {
+    load_config();
+}
+
+__attribute__((destructor)) static void shim_report(void) {
+    if (!cfg.report) return;
+    for (int op = 0; op < OP_COUNT; op++) {
+        fprintf(stderr, "latshim: %s calls=%" PRIu64 " delayed=%" PRIu64 " delay=%.3fs\n", op_names[op],
+                (uint64_t)atomic_load(&calls[op]), (uint64_t)atomic_load(&delayed[op]),
+                (double)atomic_load(&delay_ns[op]) / 1e9);
+    }
+}
+
+/* xorshift64*, seeded per thread. Returns a double in [0, 1). */
+static double rand01(void) {
+    if (rng_state == 0) {
+        uint64_t n = atomic_fetch_add(&thread_seq, 1) + 1;
+        rng_state = (cfg.seed ^ (n * 0x9e3779b97f4a7c15ULL)) | 1;
+    }
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double)((rng_state * 0x2545f4914f6cdd1dULL) >> 11) / 9007199254740992.0;
+}
+
+static double draw_us(double mean) {
+    switch (cfg.dist) {
+        case DIST_UNIFORM:
+            return 2.0 * mean * rand01();
+        case DIST_EXP:
+            return -mean * log(1.0 - rand01());
+        case DIST_LOGNORMAL: {
+            double u1 = 1.0 - rand01();
+            double z = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * rand01());
+            return mean * exp(cfg.sigma * z - cfg.sigma * cfg.sigma / 2.0);
+        }
+        case DIST_FIXED:
+        default:
+            return mean;
+    }
+}
+
+static void delay(int op) {
+    load_config();
+    atomic_fetch_add_explicit(&calls[op], 1, memory_order_relaxed);
+
+    double mean = cfg.mean_us[op];
+    if (mean <= 0.0 && cfg.jitter_us <= 0.0) return;
+    double us = (mean > 0.0 ? draw_us(mean) : 0.0) + cfg.jitter_us * rand01();
+    if (us <= 0.0) return;
+
+    if (!slack_set) {
+        prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+        slack_set = 1;
+    }
+    uint64_t ns = (uint64_t)(us * 1000.0);
+    struct timespec ts = {.tv_sec = (time_t)(ns / 1000000000u), .tv_nsec = (long)(ns % 1000000000u)};
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+    atomic_fetch_add_explicit(&delayed[op], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&delay_ns[op], ns, memory_order_relaxed);
+}
+
+/* Looks up the next definition of a wrapped function once (object-to-function pointer copy per POSIX dlsym). */
+#define REAL(name, type)                                                      \
+    static type real_##name;                                                  \
+    if (!real_##name) {                                                       \
+        void *sym = dlsym(RTLD_NEXT, #name);                                  \
+        memcpy(&real_##name, &sym, sizeof(sym));                              \
+    }
+
+typedef int (*stat_fn)(const char *, struct stat *);
+typedef int (*stat64_fn)(const char *, struct stat64 *);
+typedef int (*fstatat_fn)(int, const char *, struct stat *, int);
+typedef int (*fstatat64_fn)(int, const char *, struct stat64 *, int);
+typedef int (*statx_fn)(int, const char *, int, unsigned int, struct statx *);
+typedef int (*xstat_fn)(int, const char *, struct stat *);
+typedef int (*fxstatat_fn)(int, int, const char *, struct stat *, int);
+typedef DIR *(*opendir_fn)(const char *);
+typedef DIR *(*fdopendir_fn)(int);
+typedef int (*openat_fn)(int, const char *, int, ...);
+typedef struct dirent *(*readdir_fn)(DIR *);
+typedef struct dirent64 *(*readdir64_fn)(DIR *);
+
+int lstat(const char *path, struct stat *st) {
+    REAL(lstat, stat_fn);
+    delay(OP_STAT);
+    return real_lstat(path, st);
+}
+
+int stat(const char *path, struct stat *st) {
+    REAL(stat, stat_fn);
+    delay(OP_STAT);
+    return real_stat(path, st);
+}
+
+int lstat64(const char *path, struct stat64 *st) {
+    REAL(lstat64, stat64_fn);
+    delay(OP_STAT);
+    return real_lstat64(path, st);
+}
+
+int stat64(const char *path, struct stat64 *st) {
+    REAL(stat64, stat64_fn);
+    delay(OP_STAT);
+    return real_stat64(path, st);
+}
+
+int fstatat(int dirfd, const char *path, struct stat *st, int flags) {
+    REAL(fstatat, fstatat_fn);
+    delay(OP_STAT);
+    return real_fstatat(dirfd, path, st, flags);
+}
+
+int fstatat64(int dirfd, const char *path, struct stat64 *st, int flags) {
+    REAL(fstatat64, fstatat64_fn);
+    delay(OP_STAT);
+    return real_fstatat64(dirfd, path, st, flags);
+}
+
+int statx(int dirfd, const char *path, int flags, unsigned int mask, struct statx *stx) {
+    REAL(statx, statx_fn);
+    delay(OP_STAT);
+    return real_statx(dirfd, path, flags, mask, stx);
+}
+
+/* Entry points of binaries built against glibc < 2.33. */
+int __lxstat(int ver, const char *path, struct stat *st);
+int __xstat(int ver, const char *path, struct stat *st);
+int __fxstatat(int ver, int dirfd, const char *path, struct stat *st, int flags);
+
+int __lxstat(int ver, const char *path, struct stat *st) {
+    REAL(__lxstat, xstat_fn);
+    delay(OP_STAT);
+    return real___lxstat(ver, path, st);
+}
+
+int __xstat(int ver, const char *path, struct stat *st) {
+    REAL(__xstat, xstat_fn);
+    delay(OP_STAT);
+    return real___xstat(ver, path, st);
+}
+
+int __fxstatat(int ver, int dirfd, const char *path, struct stat *st, int flags) {
+    REAL(__fxstatat, fxstatat_fn);
+    delay(OP_STAT);
+    return real___fxstatat(ver, dirfd, path, st, flags);
+}
+
+DIR *opendir(const char *path) {
+    REAL(opendir, opendir_fn);
+    delay(OP_OPENDIR);
+    readdir_left = 0;
+    return real_opendir(path);
+}
+
+DIR *fdopendir(int fd) {
+    REAL(fdopendir, fdopendir_fn);
+    delay(OP_OPENDIR);
+    readdir_left = 0;
+    return real_fdopendir(fd);
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+    REAL(openat, openat_fn);
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, unsigned int);
+        va_end(ap);
+    }
+    if (flags & O_DIRECTORY) delay(OP_OPENDIR);
+    return real_openat(dirfd, path, flags, mode);
+}
+
+/* Every LATSHIM_READDIR_BATCH-th call on a thread pays one round trip, starting with the first after opendir. */
+static void readdir_delay(void) {
+    load_config();
+    if (readdir_left == 0) {
+        delay(OP_READDIR);
+        readdir_left = cfg.readdir_batch;
+    } else {
+        atomic_fetch_add_explicit(&calls[OP_READDIR], 1, memory_order_relaxed);
+    }
+    readdir_left--;
+}
+
+struct dirent *readdir(DIR *d) {
+    REAL(readdir, readdir_fn);
+    readdir_delay();
+    return real_readdir(d);
+}
+
+struct dirent64 *readdir64(DIR *d) {
+    REAL(readdir64, readdir64_fn);
+    readdir_delay();
+    return real_readdir64(d);
+}
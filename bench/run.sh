@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+# Throughput of sequential and -j scans under simulated metadata latency
+# (bench/latency_shim.so). Settings, from the environment:
+#   LATENCIES  delay per metadata call in microseconds (default: "100 1000 10000")
+#   JOBS       -j values; the first one is the speedup baseline (default: "1 4 16 64")
+#   DIRS       leaf directories in the tree (default: 64, under 8 top-level ones)
+#   FILES      files per leaf directory (default: 16)
+#   DIST       LATSHIM_DIST: fixed, uniform, exp or lognormal (default: fixed)
+#   JITTER     LATSHIM_JITTER_US (default: 0)
+set -euo pipefail
+
+DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BIN="${BIN:-$DIR/../du-sync}"
+SHIM="${SHIM:-$DIR/latency_shim.so}"
+LATENCIES="${LATENCIES:-100 1000 10000}"
+JOBS="${JOBS:-1 4 16 64}"
+DIRS="${DIRS:-64}"
+FILES="${FILES:-16}"
+DIST="${DIST:-fixed}"
+JITTER="${JITTER:-0}"
+
+tmp="$(mktemp -d)"
+trap 'rm -rf "$tmp"' EXIT
+
+for d in $(seq 1 "$DIRS"); do
+  leaf="$tmp/t/$((d % 8))/$d"
+  mkdir -p "$leaf"
+  for f in $(seq 1 "$FILES"); do
+    printf "%*s" "$f" "" > "$leaf/$f"
+  done
+done
+entries="$(find "$tmp/t" | wc -l)"
+expected="$("$BIN" "$tmp/t")"
+
+now_ns() {
+  date +%s%N
+}
+
+echo "# du-sync under simulated metadata latency: $entries entries, dist=$DIST, jitter=${JITTER}us"
+printf "%10s %5s %9s %11s %8s\n" latency_us jobs seconds entries/s speedup
+for lat in $LATENCIES; do
+  base=""
+  for j in $JOBS; do
+    start="$(now_ns)"
+    out="$(LD_PRELOAD="$SHIM" LATSHIM_US="$lat" LATSHIM_DIST="$DIST" LATSHIM_JITTER_US="$JITTER" \
+      "$BIN" -q -j "$j" "$tmp/t")"
+    end="$(now_ns)"
+    if [ "$out" != "$expected" ]; then
+      echo "bench: wrong total with -j $j at ${lat}us: $out (expected $expected)" >&2
+      exit 1
+    fi
+    secs="$(awk -v ns=$((end - start)) 'BEGIN { printf "%.3f", ns / 1e9 }')"
+    [ -n "$base" ] || base="$secs"
+    awk -v lat="$lat" -v j="$j" -v s="$secs" -v n="$entries" -v b="$base" \
+      'BEGIN { printf "%10d %5d %9.3f %11.0f %7.2fx\n", lat, j, s, n / s, b / s }'
+  done
+done
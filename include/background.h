@@ -0,0 +1,12 @@
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+/*
+ * Moves the calling thread to SCHED_IDLE, nice 19 and the idle I/O class, so
+ * that the scan only gets CPU and disk time nobody else wants. Threads created
+ * afterwards inherit all three: call before starting any thread. Each step is
+ * tried even if an earlier one fails. Returns 0, or -1 (errno of the first failure).
+ */
+int background_enter(void);
+
+#endif /* BACKGROUND_H */
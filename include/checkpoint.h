@@ -0,0 +1,85 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "du_sync.h"
+#include "inode_set.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Saved state of an unfinished scan: a 24-byte header ("DUSYNCK1", u32 version,
+ * u32 flags, u64 root count) followed by one section per root, in input order
+ * and host byte order:
+ *
+ *   u8 state, u8 pad[3], i32 status, u64 bytes, u32 path_len, path
+ *
+ * A running root's section goes on with its hardlink set, as runs of inodes of
+ * one device, and the directories still to be read:
+ *
+ *   u64 inode_count, runs of (u64 dev, u32 n, n x u64 ino) adding up to it
+ *   u64 task_count, task_count x (u8 kind, u64 prio, u32 path_len, path)
+ *
+ * bytes is the root's total so far, which covers exactly the inodes listed.
+ */
+enum {
+    CHECKPOINT_PENDING = 0, /* not started */
+    CHECKPOINT_RUNNING = 1,
+    CHECKPOINT_DONE = 2, /* finished with status and bytes */
+};
+
+enum {
+    CHECKPOINT_TASK_DIR = 0,  /* a directory to read */
+    CHECKPOINT_TASK_ROOT = 1, /* the root itself, not stat'ed yet */
+};
+
+typedef struct CheckpointWriter CheckpointWriter;
+
+/* Starts writing a checkpoint of nroots roots into path.tmp. Returns NULL on error (errno set). */
+CheckpointWriter *checkpoint_writer_open(const char *path, uint64_t nroots, const DuAllocator *a);
+
+/*
+ * Appends the next root section. A CHECKPOINT_RUNNING root must be followed by
+ * checkpoint_write_inodes, checkpoint_write_task_count and that many tasks.
+ * Write errors are reported by checkpoint_writer_close.
+ */
+void checkpoint_write_root(CheckpointWriter *w, uint8_t state, int status, uint64_t bytes, const char *path);
+void checkpoint_write_inodes(CheckpointWriter *w, const InodeSet *seen);
+void checkpoint_write_task_count(CheckpointWriter *w, uint64_t n);
+void checkpoint_write_task(CheckpointWriter *w, uint8_t kind, uint64_t prio, const char *path);
+
+/* Appends root section i of c unchanged. */
+void checkpoint_write_copy(CheckpointWriter *w, const Checkpoint *c, size_t i);
+
+/*
+ * Syncs path.tmp and renames it over path, so path always holds a complete
+ * checkpoint; after an error the temporary file is removed instead. Frees w.
+ * Returns 0, or -1 on I/O error (errno set).
+ */
+int checkpoint_writer_close(CheckpointWriter *w);
+
+/* checkpoint_open, checkpoint_close and checkpoint_matches are declared in du_sync.h. */
+
+typedef struct CheckpointRoot {
+    uint8_t state;
+    int status;
+    uint64_t bytes;
+} CheckpointRoot;
+
+void checkpoint_root(const Checkpoint *c, size_t i, CheckpointRoot *out);
+
+/* Inserts the hardlink set of running root i into seen. Returns 0, or -1 on OOM. */
+int checkpoint_load_inodes(const Checkpoint *c, size_t i, InodeSet *seen);
+
+typedef struct CheckpointTask {
+    uint8_t kind;
+    uint64_t prio;
+    const char *path; /* not NUL-terminated */
+    size_t path_len;
+} CheckpointTask;
+
+/* Iterates the tasks of running root i: start with *pos = 0. Returns false after the last one. */
+bool checkpoint_next_task(const Checkpoint *c, size_t i, size_t *pos, CheckpointTask *out);
+
+#endif /* CHECKPOINT_H */
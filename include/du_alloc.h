@@ -0,0 +1,23 @@
+#ifndef DU_ALLOC_H
+#define DU_ALLOC_H
+
+#include <stddef.h>
+
+/*
+ * Caller-supplied allocator hooks. Either all three functions are set or none;
+ * a NULL allocator (or one with NULL functions) means the C library allocator.
+ * The functions may be called concurrently from worker threads.
+ */
+typedef struct DuAllocator {
+    void *(*alloc_fn)(void *user, size_t size);
+    void *(*realloc_fn)(void *user, void *ptr, size_t size);
+    void (*free_fn)(void *user, void *ptr);
+    void *user;
+} DuAllocator;
+
+void *du_malloc(const DuAllocator *a, size_t size);
+void *du_calloc(const DuAllocator *a, size_t n, size_t size);
+void *du_realloc(const DuAllocator *a, void *ptr, size_t size);
+void du_free(const DuAllocator *a, void *ptr);
+
+#endif /* DU_ALLOC_H */
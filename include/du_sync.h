@@ -1,16 +1,258 @@
 #ifndef DU_SYNC_H
 #define DU_SYNC_H
 
+#include "du_alloc.h"
+#include "group_map.h"
+#include "manifest.h"
+
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/stat.h>
+
+typedef enum DuGroupBy {
+    DU_GROUP_NONE = 0,
+    DU_GROUP_UID,
+    DU_GROUP_GID,
+    DU_GROUP_EXT,
+    DU_GROUP_AGE,
+} DuGroupBy;
+
+typedef enum DuSchedule {
+    DU_SCHEDULE_FIFO = 0,      /* directories are read in discovery order */
+    DU_SCHEDULE_LARGEST_FIRST, /* directories with the largest estimated subtree are read first */
+} DuSchedule;
 
+/*
+ * Sharding: with shard_count > 1 only part shard_index of each root is scanned.
+ * shard_index is 0-based; the CLI's --shard I/N passes I - 1.
+ * The directories shard_level below the root are divided among the shards by a
+ * hash of their path relative to the root, so scans with every index, on any
+ * host, cover each entry exactly once. The levels above are read by all shards,
+ * but their other entries (and a root that is not a directory) belong to shard 0.
+ * A file hardlinked into several parts is counted by each shard that reaches it;
+ * DuEntry.counted and st_nlink tell which files may need a cross-shard merge.
+ * du_scan_run_list and checkpoints do not shard and return 2.
+ */
 typedef struct DuOptions {
     bool quiet;
     bool stdin_nul;
     int jobs;
     bool debug_threads;
+    DuGroupBy group_by;
+    size_t max_queued;    /* jobs > 1: cap on queued directories, beyond which workers descend inline; 0: none */
+    size_t split_entries; /* jobs > 1: directories with more entries are stat'ed by all workers; 0: never */
+    DuSchedule schedule;  /* jobs > 1: order of queued directories */
+    unsigned shard_index; /* part of the tree to scan, 0 .. shard_count - 1 (see above) */
+    unsigned shard_count; /* 0 or 1: no sharding */
+    unsigned shard_level; /* depth of the directories divided among shards, >= 1 */
 } DuOptions;
 
+typedef enum DuEntryKind {
+    DU_ENTRY_FILE = 0, /* regular file */
+    DU_ENTRY_DIR,
+    DU_ENTRY_OTHER, /* symlink, device, fifo, socket */
+} DuEntryKind;
+
+typedef struct DuEntry {
+    DuEntryKind kind;
+    const char *path;
+    const struct stat *st;
+    bool counted; /* DU_ENTRY_FILE: first occurrence of its inode, included in the total */
+    size_t root;  /* index of the root in du_scan_run_many (DuRootResult.index); 0 otherwise */
+} DuEntry;
+
+/* Called for every diagnostic (errnum is the errno value). Default: print to stderr unless quiet. */
+typedef void (*DuErrorFn)(void *user, const char *msg, const char *path, int errnum);
+
+/*
+ * Called for every entry found. Return 0 to continue, DU_ENTRY_NOMEM to stop the
+ * scan as out of memory (status 1), or any other value to abort it (status 3).
+ */
+typedef int (*DuEntryFn)(void *user, const DuEntry *entry);
+
+enum { DU_ENTRY_NOMEM = -1 };
+
+/*
+ * Both callbacks run on the thread that found the entry, i.e. concurrently on
+ * worker threads when jobs > 1, and must be thread-safe in that case.
+ */
+typedef struct DuCallbacks {
+    DuErrorFn on_error;
+    DuEntryFn on_entry;
+    void *user;
+} DuCallbacks;
+
+/*
+ * Reentrant scan context: holds options, callbacks and allocator; all traversal
+ * state lives in du_scan_run, so independent contexts can run concurrently.
+ * A single context runs one scan at a time.
+ */
+typedef struct DuScan DuScan;
+
+/* opt, cb and alloc are copied and may be NULL. Returns NULL on OOM or a partial allocator. */
+DuScan *du_scan_create(const DuOptions *opt, const DuCallbacks *cb, const DuAllocator *alloc);
+void du_scan_destroy(DuScan *scan);
+
+/*
+ * Records every directory and regular file of subsequent runs into w (not owned;
+ * NULL stops recording). Several runs may share one writer; each root becomes a
+ * top-level directory of the manifest.
+ */
+void du_scan_set_manifest(DuScan *scan, ManifestWriter *w);
+
+/*
+ * Uses the recursive entry counts of a previous scan's manifest (not owned; NULL
+ * to stop) as subtree estimates for DU_SCHEDULE_LARGEST_FIRST. Directories are
+ * matched by path; new ones fall back to the stat-based estimate.
+ */
+void du_scan_set_history(DuScan *scan, const ManifestSizes *h);
+
+/*
+ * Sums the sizes of regular files under root_path, counting each (st_dev, st_ino)
+ * once. If groups is non-NULL and opt->group_by is set, the counted files are also
+ * aggregated into groups.
+ * Returns 0 on success (errors on individual entries are reported, not fatal),
+ * 1 on fatal error (OOM), 2 on invalid arguments, 3 if aborted by on_entry.
+ */
+int du_scan_run(DuScan *scan, const char *root_path, uint64_t *out_bytes, GroupMap *groups);
+
+typedef struct DuRootResult {
+    size_t index; /* position in the roots array */
+    const char *path;
+    int status; /* as returned by du_scan_run */
+    uint64_t bytes;
+    const GroupMap *groups; /* NULL when not grouping; valid during the callback only */
+} DuRootResult;
+
+typedef void (*DuResultFn)(void *user, const DuRootResult *r);
+
+/*
+ * Scans n independent roots (each with its own hardlink set, like n calls of
+ * du_scan_run) on one worker pool, so a slow root does not keep the workers of
+ * the others idle. on_result runs on the calling thread once per root, never
+ * concurrently: in input order when ordered is true, otherwise in completion
+ * order. At most `window` roots (at least 1) are in flight; in ordered mode a
+ * root that is still running holds back the delivery, and admission, of roots
+ * `window` or more positions after it. After a fatal error the roots not yet
+ * delivered are reported with that status.
+ * Returns 0, or the first fatal status (1 OOM, 2 invalid arguments, 3 aborted).
+ * Checkpoints (see below) need opt->group_by unset and no manifest, and a resumed
+ * checkpoint the same roots; otherwise 2 is returned before any root is scanned.
+ */
+int du_scan_run_many(DuScan *scan, const char *const *roots, size_t n, size_t window, bool ordered,
+                     DuResultFn on_result, void *user);
+
+/*
+ * File-list mode (like `du --files0-from -c`): each path costs about one lstat.
+ * Paths are lstat'ed in parallel batches on a worker pool when jobs > 1, and one
+ * hardlink set spans the whole list, so a file linked under several listed names
+ * counts once, for its first name. A listed directory is traversed on the calling
+ * thread. on_result runs on the calling thread once per path, in list order
+ * (r->groups is NULL); *out_total gets the grand total and, if groups is non-NULL
+ * and opt->group_by is set, the counted files are aggregated into groups.
+ * Only listed directories are recorded in a manifest. Returns like du_scan_run_many.
+ */
+int du_scan_run_list(DuScan *scan, const char *const *paths, size_t n, DuResultFn on_result, void *user,
+                     uint64_t *out_total, GroupMap *groups);
+
+/*
+ * Makes du_scan_run_many save its state to path (not copied; NULL to stop)
+ * every `interval` seconds: the traversal pauses between directories while the
+ * pending directories, totals and hardlink sets of the roots in flight, and the
+ * results delivered so far, are written to path.tmp, which then replaces path.
+ * The file is removed once a run completes without a fatal error.
+ */
+void du_scan_set_checkpoint(DuScan *scan, const char *path, double interval);
+
+/* A saved run, opened to be continued with du_scan_set_resume. */
+typedef struct Checkpoint Checkpoint;
+
+/*
+ * Maps and validates a checkpoint file; a and cb (may be NULL) are copied, as by
+ * du_scan_create. Returns NULL on error, which is passed to cb->on_error (errnum
+ * 0 for a file that is not a valid checkpoint) and left in errno.
+ */
+Checkpoint *checkpoint_open(const char *path, const DuAllocator *a, const DuCallbacks *cb);
+void checkpoint_close(Checkpoint *c);
+
+/* True if c was written for exactly these roots, in this order. */
+bool checkpoint_matches(const Checkpoint *c, const char *const *roots, size_t n);
+
+/*
+ * Makes du_scan_run_many continue the run saved in c (not owned; NULL to start
+ * afresh): finished roots are delivered again with their saved results, running
+ * ones go on from their pending directories and hardlink sets. On an unchanged
+ * tree the results equal those of an uninterrupted run, with any jobs count.
+ */
+void du_scan_set_resume(DuScan *scan, const Checkpoint *c);
+
+typedef struct DuProgress {
+    uint64_t dirs;   /* directories read */
+    uint64_t files;  /* regular files found */
+    uint64_t bytes;  /* bytes counted so far */
+    uint64_t queued; /* directories waiting to be read */
+    uint64_t peak_queued;
+} DuProgress;
+
+/*
+ * Turns on progress counters for subsequent runs (off by default, when they cost
+ * nothing). Each thread updates its own counters with relaxed atomics.
+ * Returns 0, 1 on OOM, 2 on invalid arguments.
+ */
+int du_scan_enable_progress(DuScan *scan);
+
+/* Snapshot of the counters summed over all runs so far; callable from any thread during a run. */
+void du_scan_progress(const DuScan *scan, DuProgress *out);
+
+/* Largest number of directories queued at once (the traversal frontier) in any completed run. */
+size_t du_scan_peak_queued(const DuScan *scan);
+
+typedef struct DuThrottle {
+    double stats_per_sec; /* 0: unlimited */
+    double dirs_per_sec;  /* directories opened per second; 0: unlimited */
+    double slow_stat;     /* seconds: back off while stats take longer than this on average; 0: never */
+} DuThrottle;
+
+/*
+ * Limits the metadata load of subsequent runs (NULL: no limits). Each rate is a
+ * token bucket holding 100ms worth of tokens, shared by all threads of the scan
+ * through one atomic timestamp rather than a lock. With slow_stat set, while
+ * the moving average of stat latency stays above it every thread pauses after
+ * each stat for a multiple of that average, doubled every 100ms up to 16x and
+ * lowered by one once latency recovers. Thread priorities are left to the
+ * caller. Not to be called during a run. Returns 0, 1 on OOM, 2 on invalid arguments.
+ */
+int du_scan_set_throttle(DuScan *scan, const DuThrottle *t);
+
+typedef struct DuEstimateOptions {
+    double time_budget;      /* seconds; <= 0 means no time limit */
+    double target_rel_error; /* stop once the 95% CI half-width / estimate <= this; <= 0 disables */
+    uint64_t max_probes;     /* 0 means no limit */
+    uint64_t seed;           /* 0 picks a time-based seed */
+} DuEstimateOptions;
+
+typedef struct DuEstimate {
+    double bytes;
+    double bytes_ci95; /* half-width of the 95% confidence interval */
+    double files;
+    double files_ci95;
+    uint64_t probes;
+    bool exact; /* the whole tree was read; bytes/files are exact */
+} DuEstimate;
+
+/*
+ * Estimates bytes and regular file count under root_path by random root-to-leaf
+ * probes (Knuth's estimator) over a cached directory tree, stopping at the first
+ * budget reached in eo (set at least one). Runs on the calling thread.
+ * Returns 0 on success, 1 on OOM, 2 on invalid arguments.
+ */
+int du_scan_estimate(DuScan *scan, const char *root_path, const DuEstimateOptions *eo, DuEstimate *out);
+
+/* One-shot helpers using a temporary context with default callbacks. */
 int du_sync_sum_regular_bytes(const char *root_path, const DuOptions *opt, uint64_t *out_bytes);
+int du_sync_sum_grouped(const char *root_path, const DuOptions *opt, uint64_t *out_bytes, GroupMap *groups);
+
+/* Label of an age bucket id produced by DU_GROUP_AGE (e.g. "7d-30d"). */
+const char *du_sync_age_bucket_name(uint64_t bucket);
 
 #endif /* DU_SYNC_H */
@@ -0,0 +1,49 @@
+#ifndef GROUP_MAP_H
+#define GROUP_MAP_H
+
+#include "du_alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Aggregates (bytes, files) per group key. A key is either numeric (uid, gid,
+ * age bucket) or a short string (file extension); a map holds one kind only.
+ * Not thread-safe: the parallel traversal keeps one map per worker and root and
+ * merges them when the root completes.
+ */
+typedef struct GroupMap GroupMap;
+
+typedef struct GroupRow {
+    uint64_t id;      /* numeric key (unused for string keys) */
+    const char *name; /* string key or NULL; owned by the map */
+    uint64_t bytes;
+    uint64_t files;
+} GroupRow;
+
+GroupMap *group_map_create(void);
+/* Same, but map memory comes from a (copied; may be NULL). */
+GroupMap *group_map_create_with(const DuAllocator *a);
+void group_map_destroy(GroupMap *m);
+
+/* Adds bytes to the group. Return 0 on success, -1 on OOM. */
+int group_map_add_id(GroupMap *m, uint64_t id, uint64_t bytes);
+int group_map_add_name(GroupMap *m, const char *name, size_t name_len, uint64_t bytes);
+
+/* Folds all groups of src into dst. Returns 0 on success, -1 on OOM. */
+int group_map_merge(GroupMap *dst, const GroupMap *src);
+
+/* Removes all groups, keeping the allocated table. */
+void group_map_clear(GroupMap *m);
+
+/*
+ * Returns an array of rows sorted by bytes (descending), allocated from the map's
+ * allocator; *out_len gets the row count. Row names stay valid until the map is
+ * modified or destroyed. Returns NULL on OOM or when the map is empty.
+ */
+GroupRow *group_map_rows(const GroupMap *m, size_t *out_len);
+
+/* Frees the rows returned by group_map_rows(m, ...) (may be NULL). */
+void group_map_rows_free(const GroupMap *m, GroupRow *rows);
+
+#endif /* GROUP_MAP_H */
@@ -1,6 +1,8 @@
 #ifndef INODE_SET_H
 #define INODE_SET_H
 
+#include "du_alloc.h"
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <sys/types.h>
@@ -13,6 +15,8 @@ typedef struct InodeKey {
 typedef struct InodeSet InodeSet;
 
 InodeSet *inode_set_create(void);
+/* Same, but all memory of the set comes from a (copied; may be NULL). */
+InodeSet *inode_set_create_with(const DuAllocator *a);
 void inode_set_destroy(InodeSet *set);
 
 /*
@@ -24,4 +28,9 @@ void inode_set_destroy(InodeSet *set);
  */
 bool inode_set_insert(InodeSet *set, InodeKey key, bool *oom);
 
+size_t inode_set_size(const InodeSet *set);
+
+/* Iterates the keys in table order: start with *pos = 0. Returns false after the last key. */
+bool inode_set_next(const InodeSet *set, size_t *pos, InodeKey *out);
+
 #endif /* INODE_SET_H */
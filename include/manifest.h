@@ -0,0 +1,98 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "du_alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Binary scan manifest: a 16-byte header ("DUSYNCM1", u32 version, u32 flags)
+ * followed by variable-length records in host byte order:
+ *
+ *   u8 type, u8 flags, u16 name_len, u64 id, u64 parent, u64 size,
+ *   u64 dev, u64 ino, i64 mtime, name[name_len]   (no terminator)
+ *
+ * Directory records carry their own id and the id of the directory containing
+ * them (0 for a scan root, whose name is the root path as given). File records
+ * carry the id of the directory containing them in `id` and 0 in `parent`.
+ * Ids are unique per manifest and a directory's id is always greater than its
+ * parent's; records of different directories may be interleaved in any order.
+ */
+enum {
+    MANIFEST_DIR = 1,
+    MANIFEST_FILE = 2,
+};
+
+enum {
+    MANIFEST_COUNTED = 1,    /* first occurrence of the inode in this scan */
+    MANIFEST_MULTI_LINK = 2, /* st_nlink > 1: may appear under several names */
+};
+
+typedef struct ManifestRecord {
+    uint8_t type;
+    uint8_t flags;
+    uint64_t id;
+    uint64_t parent;
+    uint64_t size;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime;
+    const char *name;
+    size_t name_len;
+} ManifestRecord;
+
+/*
+ * Records are staged by each producer thread in its own block and handed to a
+ * dedicated writer thread when the block is full, which writes it with large
+ * sequential write()s.
+ */
+typedef struct ManifestWriter ManifestWriter;
+typedef struct ManifestBlock ManifestBlock;
+
+/* Creates/truncates path and starts the writer thread. Returns NULL on error (errno set). */
+ManifestWriter *manifest_writer_open(const char *path, const DuAllocator *a);
+
+/* Flushes, joins the writer thread and closes the file. Returns 0, or -1 on I/O error (errno set). */
+int manifest_writer_close(ManifestWriter *w);
+
+/* Allocates a new directory id (thread-safe). */
+uint64_t manifest_new_dir_id(ManifestWriter *w);
+
+/* Appends r to the caller's block *cur (allocated on demand). Returns 0, or -1 on OOM. */
+int manifest_append(ManifestWriter *w, ManifestBlock **cur, const ManifestRecord *r);
+
+/* Hands the caller's partially filled block to the writer thread. */
+void manifest_flush(ManifestWriter *w, ManifestBlock **cur);
+
+/*
+ * Compares two manifests (memory-mapped, no filesystem access) and prints one
+ * line per directory whose recursive byte total differs:
+ *   "<delta>\t<bytes_a>\t<bytes_b>\t<path>"
+ * Directories are matched by path; a directory missing on one side counts as 0.
+ * Like `du -s DIR`, a hardlinked inode counts once in every directory whose
+ * subtree holds one of its links, so totals do not depend on traversal order.
+ * Runs in time linear in the manifest sizes (plus sorting the multi-link files). Returns 0, 1 on OOM or I/O error,
+ * 2 if a file is not a valid manifest (a message is printed to stderr).
+ */
+int manifest_diff(const char *path_a, const char *path_b, FILE *out);
+
+/*
+ * Recursive totals of a previous scan's directories, looked up one path
+ * component at a time. Read-only once opened, so lookups are thread-safe.
+ */
+typedef struct ManifestSizes ManifestSizes;
+
+/* Returns NULL on error (a message is printed to stderr). */
+ManifestSizes *manifest_sizes_open(const char *path);
+void manifest_sizes_close(ManifestSizes *h);
+
+/* Id of directory `name` under directory `parent` (0: a scan root named by its path); 0 if absent. */
+uint64_t manifest_sizes_find(const ManifestSizes *h, uint64_t parent, const char *name, size_t len);
+
+/* Recursive entry count (files and directories) and bytes of a directory id; 0 if unknown. */
+uint64_t manifest_sizes_entries(const ManifestSizes *h, uint64_t id);
+uint64_t manifest_sizes_bytes(const ManifestSizes *h, uint64_t id);
+
+#endif /* MANIFEST_H */
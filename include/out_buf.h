@@ -0,0 +1,37 @@
+#ifndef OUT_BUF_H
+#define OUT_BUF_H
+
+#include <stddef.h>
+
+/*
+ * Output stage for result lines: text accumulates in one large buffer that is
+ * written with a single write() per full block, instead of stdio's line-at-a-time
+ * flushing when many roots are printed. On a terminal each result is flushed as
+ * soon as it is complete (out_buf_end_record).
+ */
+typedef struct OutBuf {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+    int interactive; /* fd is a terminal: flush at every record end */
+    int err;         /* errno of the first failed write, 0 if none */
+} OutBuf;
+
+/* Returns 0, or -1 on OOM. */
+int out_buf_init(OutBuf *b, int fd, size_t cap);
+
+/* Writes pending output and frees the buffer. Returns 0, or -1 if any write failed. */
+int out_buf_destroy(OutBuf *b);
+
+/* Appends formatted text; lines longer than the buffer are written directly. */
+void out_buf_printf(OutBuf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void out_buf_write(OutBuf *b, const char *p, size_t n);
+
+/* Marks the end of one result (its total and detail lines). */
+void out_buf_end_record(OutBuf *b);
+
+void out_buf_flush(OutBuf *b);
+
+#endif /* OUT_BUF_H */
@@ -1,6 +1,8 @@
 #ifndef PATH_UTIL_H
 #define PATH_UTIL_H
 
+#include "du_alloc.h"
+
 #include <stddef.h>
 
 /* Joins base + "/" + name (handles base trailing slash). Returns malloc'd string or NULL on OOM. */
@@ -9,6 +11,10 @@ char *path_join(const char *base, const char *name);
 /* Safe strdup (returns NULL on OOM). */
 char *xstrdup(const char *s);
 
+/* Variants allocating from a (NULL means malloc); free the result with du_free(a, ...). */
+char *path_join_with(const DuAllocator *a, const char *base, const char *name);
+char *xstrdup_with(const DuAllocator *a, const char *s);
+
 /* Returns true if stdin is a TTY. */
 int stdin_is_tty(void);
 
@@ -0,0 +1,25 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "du_sync.h"
+
+/*
+ * Progress reporter thread: every `interval` seconds (0: never) and on every
+ * SIGUSR1 it reads the scan's counters and prints one line with totals and
+ * rates to stderr, or atomically replaces status_path with it.
+ */
+typedef struct ProgressReporter ProgressReporter;
+
+/*
+ * Blocks SIGUSR1 in the calling thread and every thread it creates later, so
+ * only the reporter receives it. Call before starting any thread. Returns 0 or -1.
+ */
+int progress_block_signal(void);
+
+/* Returns NULL on error (errno set). progress must be enabled on scan. */
+ProgressReporter *progress_start(const DuScan *scan, double interval, const char *status_path);
+
+/* Stops and joins the reporter; a status file gets a final line. */
+void progress_stop(ProgressReporter *r);
+
+#endif /* PROGRESS_H */
@@ -0,0 +1,48 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "du_sync.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Result file of one shard (du-sync --shard): a 40-byte header ("DUSYNCS1",
+ * u32 version, u32 flags, u32 shard index, u32 shard count, u32 shard level,
+ * u32 pad, u64 root count) followed by one section per root, in delivery
+ * order and host byte order:
+ *
+ *   i32 status, u32 path_len, u64 root index, u64 bytes, u64 link_count, path,
+ *   link_count x (u64 dev, u64 ino, u64 size)
+ *
+ * The links are the counted files with st_nlink > 1, which other shards may
+ * have counted as well; bytes is the shard's total without them.
+ */
+typedef struct ShardFile ShardFile;
+
+/* Creates/truncates path. Returns NULL on error (errno set). */
+ShardFile *shard_file_create(const char *path, unsigned index, unsigned count, unsigned level, uint64_t nroots);
+
+/*
+ * DuEntryFn collecting links per root (DuEntry.root), so any number of roots
+ * may be in flight; thread-safe. Returns DU_ENTRY_NOMEM on OOM.
+ */
+int shard_file_note_entry(void *user, const DuEntry *e);
+
+/* Appends the section of a delivered root (any order) and frees its links. */
+void shard_file_add_root(ShardFile *f, const DuRootResult *r);
+
+/* Returns 0, or -1 on I/O error (errno set). Frees f. */
+int shard_file_close(ShardFile *f);
+
+/*
+ * Combines the files of all shards of one run and prints "<bytes>\t<path>" per
+ * root, counting each hardlinked inode once across shards. Roots are matched by
+ * index, so shards may have scanned the tree under different mount paths; the
+ * paths printed are those in paths[0]. A root that failed in any shard is not
+ * printed. Returns 0, 1 on such a failure or OOM, 2 if the files are invalid or
+ * not exactly one per shard (a message is printed to stderr).
+ */
+int shard_merge(const char *const *paths, size_t n, FILE *out);
+
+#endif /* SHARD_H */
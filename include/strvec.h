@@ -3,10 +3,26 @@
 
 #include <stddef.h>
 
+/* A storage region owned by a StrVec: a heap block/string or a private file mapping. */
+typedef struct StrBlock {
+    void *p;
+    size_t len;
+    int mapped;
+} StrBlock;
+
+/*
+ * Vector of NUL-terminated strings. Items either own a malloc'd string (strvec_push)
+ * or point into a few large blocks shared by many items (strvec_read_from_stdin);
+ * all storage is released by strvec_destroy.
+ */
 typedef struct StrVec {
     char **items;
     size_t len;
     size_t cap;
+
+    StrBlock *blocks;
+    size_t blocks_len;
+    size_t blocks_cap;
 } StrVec;
 
 void strvec_init(StrVec *v);
@@ -15,7 +31,15 @@ void strvec_destroy(StrVec *v);
 /* Pushes a malloc'd string owned by vec. Returns 0 on success, nonzero on OOM. */
 int strvec_push(StrVec *v, char *s);
 
-/* Reads paths from stdin, split by delim ('\n' or '\0'). Returns 0 on success, nonzero on OOM. */
+/*
+ * Reads paths from stdin, split by delim ('\n' or '\0'); empty entries are skipped.
+ * A regular file on stdin is mmap'd and split in place; otherwise stdin is read in
+ * 1 MiB blocks. Delimiters are found with memchr and paths are stored as slices of
+ * the blocks, with no per-path allocation. Returns 0 on success, nonzero on OOM.
+ */
 int strvec_read_from_stdin(StrVec *v, int delim);
 
+/* Same, reading from fd (which is not closed). */
+int strvec_read_fd(StrVec *v, int fd, int delim);
+
 #endif /* STRVEC_H */
@@ -0,0 +1,35 @@
+#define _GNU_SOURCE
+
+#include "background.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* From linux/ioprio.h, which glibc does not wrap. */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+int background_enter(void) {
+    int err = 0;
+
+    /* Linux applies these to the calling thread only (who 0); new threads copy them. */
+    if (setpriority(PRIO_PROCESS, 0, 19) != 0 && !err) err = errno;
+
+    struct sched_param sp = {.sched_priority = 0};
+    if (sched_setscheduler(0, SCHED_IDLE, &sp) != 0 && !err) err = errno;
+
+#ifdef SYS_ioprio_set
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0 && !err)
+        err = errno;
+#else
+    if (!err) err = ENOSYS;
+#endif
+
+    if (!err) return 0;
+    errno = err;
+    return -1;
+}
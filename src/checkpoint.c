@@ -0,0 +1,374 @@
+#define _XOPEN_SOURCE 700
+
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "DUSYNCK1"
+#define CHECKPOINT_VERSION 1u
+#define CHECKPOINT_HEADER_SIZE 24u
+#define CHECKPOINT_ROOT_FIXED 20u
+#define CHECKPOINT_RUN_FIXED 12u
+#define CHECKPOINT_TASK_FIXED 13u
+#define CHECKPOINT_RUN_MAX 1024u
+#define CHECKPOINT_BUF_SIZE ((size_t)1 << 20)
+
+/* ---------------- Writer ---------------- */
+
+struct CheckpointWriter {
+    DuAllocator alloc;
+    char *path;
+    char *tmp;
+    FILE *f;
+    char *buf;
+    int err; /* errno of the first failed write, 0 otherwise */
+
+    uint64_t run_dev; /* inodes of the current run, written once it is full or the device changes */
+    uint32_t run_len;
+    uint64_t run[CHECKPOINT_RUN_MAX];
+};
+
+static void put(CheckpointWriter *w, const void *p, size_t n) {
+    if (w->err || n == 0) return;
+    if (fwrite(p, 1, n, w->f) != n) w->err = errno ? errno : EIO;
+}
+
+static void put_u32(CheckpointWriter *w, uint32_t v) {
+    put(w, &v, sizeof(v));
+}
+
+static void put_u64(CheckpointWriter *w, uint64_t v) {
+    put(w, &v, sizeof(v));
+}
+
+CheckpointWriter *checkpoint_writer_open(const char *path, uint64_t nroots, const DuAllocator *a) {
+    CheckpointWriter *w = (CheckpointWriter *)du_calloc(a, 1, sizeof(CheckpointWriter));
+    if (!w) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (a) w->alloc = *a;
+
+    size_t n = strlen(path) + 5;
+    w->path = (char *)du_malloc(a, n);
+    w->tmp = (char *)du_malloc(a, n);
+    w->buf = (char *)du_malloc(a, CHECKPOINT_BUF_SIZE);
+    errno = ENOMEM;
+    if (w->path && w->tmp && w->buf) {
+        memcpy(w->path, path, n - 4);
+        snprintf(w->tmp, n, "%s.tmp", path);
+        w->f = fopen(w->tmp, "w");
+    }
+    if (!w->f) {
+        int err = errno;
+        du_free(a, w->path);
+        du_free(a, w->tmp);
+        du_free(a, w->buf);
+        du_free(a, w);
+        errno = err;
+        return NULL;
+    }
+    setvbuf(w->f, w->buf, _IOFBF, CHECKPOINT_BUF_SIZE);
+
+    put(w, CHECKPOINT_MAGIC, 8);
+    put_u32(w, CHECKPOINT_VERSION);
+    put_u32(w, 0);
+    put_u64(w, nroots);
+    return w;
+}
+
+void checkpoint_write_root(CheckpointWriter *w, uint8_t state, int status, uint64_t bytes, const char *path) {
+    unsigned char head[4] = {state, 0, 0, 0};
+    int32_t st = (int32_t)status;
+    uint32_t len = (uint32_t)strlen(path);
+    put(w, head, sizeof(head));
+    put(w, &st, sizeof(st));
+    put_u64(w, bytes);
+    put_u32(w, len);
+    put(w, path, len);
+}
+
+static void run_flush(CheckpointWriter *w) {
+    if (w->run_len == 0) return;
+    put_u64(w, w->run_dev);
+    put_u32(w, w->run_len);
+    put(w, w->run, (size_t)w->run_len * sizeof(uint64_t));
+    w->run_len = 0;
+}
+
+void checkpoint_write_inodes(CheckpointWriter *w, const InodeSet *seen) {
+    put_u64(w, (uint64_t)inode_set_size(seen));
+
+    size_t pos = 0;
+    InodeKey k;
+    while (inode_set_next(seen, &pos, &k)) {
+        uint64_t dev = (uint64_t)k.dev;
+        if (w->run_len == CHECKPOINT_RUN_MAX || (w->run_len > 0 && dev != w->run_dev)) run_flush(w);
+        w->run_dev = dev;
+        w->run[w->run_len++] = (uint64_t)k.ino;
+    }
+    run_flush(w);
+}
+
+void checkpoint_write_task_count(CheckpointWriter *w, uint64_t n) {
+    put_u64(w, n);
+}
+
+void checkpoint_write_task(CheckpointWriter *w, uint8_t kind, uint64_t prio, const char *path) {
+    uint32_t len = (uint32_t)strlen(path);
+    put(w, &kind, 1);
+    put_u64(w, prio);
+    put_u32(w, len);
+    put(w, path, len);
+}
+
+int checkpoint_writer_close(CheckpointWriter *w) {
+    if (fflush(w->f) != 0 && !w->err) w->err = errno;
+    if (!w->err && fsync(fileno(w->f)) != 0) w->err = errno;
+    if (fclose(w->f) != 0 && !w->err) w->err = errno;
+    if (!w->err && rename(w->tmp, w->path) != 0) w->err = errno;
+    if (w->err) unlink(w->tmp);
+
+    int err = w->err;
+    DuAllocator a = w->alloc;
+    du_free(&a, w->path);
+    du_free(&a, w->tmp);
+    du_free(&a, w->buf);
+    du_free(&a, w);
+    if (!err) return 0;
+    errno = err;
+    return -1;
+}
+
+/* ---------------- Reader ---------------- */
+
+typedef struct RootInfo {
+    uint8_t state;
+    int32_t status;
+    uint64_t bytes;
+    const unsigned char *path;
+    uint32_t path_len;
+    size_t begin; /* section bounds */
+    size_t end;
+    size_t inodes; /* offset of the inode count (running roots) */
+    size_t tasks;  /* offset of the task count (running roots) */
+} RootInfo;
+
+struct Checkpoint {
+    DuAllocator alloc;
+    DuCallbacks cb;
+    const char *path;
+    const unsigned char *data;
+    size_t size;
+    size_t nroots;
+    RootInfo *roots;
+};
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+/* Reports msg through the caller's on_error, if any, and leaves errnum in errno. */
+static void ck_report(const Checkpoint *c, const char *msg, int errnum) {
+    if (c->cb.on_error) c->cb.on_error(c->cb.user, msg, c->path, errnum);
+    errno = errnum;
+}
+
+static int ck_invalid(const Checkpoint *c, const char *why) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "not a valid checkpoint (%s)", why);
+    ck_report(c, msg, 0);
+    errno = EINVAL;
+    return 2;
+}
+
+/* Validates the running part of a section starting at *off. Returns 0 or 2. */
+static int ck_parse_running(Checkpoint *c, RootInfo *r, size_t *off) {
+    size_t o = *off;
+    if (c->size - o < 8) return ck_invalid(c, "truncated hardlink set");
+    r->inodes = o;
+    uint64_t left = get_u64(c->data + o);
+    o += 8;
+    while (left > 0) {
+        if (c->size - o < CHECKPOINT_RUN_FIXED) return ck_invalid(c, "truncated hardlink set");
+        uint32_t n = get_u32(c->data + o + 8);
+        if (n == 0 || n > left || (c->size - o - CHECKPOINT_RUN_FIXED) / 8 < n)
+            return ck_invalid(c, "bad inode run");
+        o += CHECKPOINT_RUN_FIXED + (size_t)n * 8;
+        left -= n;
+    }
+
+    if (c->size - o < 8) return ck_invalid(c, "truncated task list");
+    r->tasks = o;
+    uint64_t ntasks = get_u64(c->data + o);
+    o += 8;
+    for (uint64_t i = 0; i < ntasks; i++) {
+        if (c->size - o < CHECKPOINT_TASK_FIXED) return ck_invalid(c, "truncated task list");
+        uint8_t kind = c->data[o];
+        uint32_t len = get_u32(c->data + o + 9);
+        if (kind > CHECKPOINT_TASK_ROOT || len == 0 || c->size - o - CHECKPOINT_TASK_FIXED < len)
+            return ck_invalid(c, "bad task");
+        o += CHECKPOINT_TASK_FIXED + len;
+    }
+    *off = o;
+    return 0;
+}
+
+/* Maps c->path and indexes its root sections. Returns 0, 1 on OOM/I/O error, 2 if invalid. */
+static int ck_load(Checkpoint *c) {
+    int fd = open(c->path, O_RDONLY);
+    if (fd < 0) {
+        ck_report(c, "cannot open checkpoint", errno);
+        return 1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        ck_report(c, "cannot stat checkpoint", errno);
+        close(fd);
+        return 1;
+    }
+    if ((size_t)sb.st_size < CHECKPOINT_HEADER_SIZE) {
+        close(fd);
+        return ck_invalid(c, "too short");
+    }
+
+    c->size = (size_t)sb.st_size;
+    void *p = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        ck_report(c, "cannot map checkpoint", errno);
+        c->size = 0;
+        return 1;
+    }
+    c->data = (const unsigned char *)p;
+
+    if (memcmp(c->data, CHECKPOINT_MAGIC, 8) != 0) return ck_invalid(c, "bad magic");
+    if (get_u32(c->data + 8) != CHECKPOINT_VERSION) return ck_invalid(c, "unsupported version");
+    uint64_t nroots = get_u64(c->data + 16);
+    if (nroots > (c->size - CHECKPOINT_HEADER_SIZE) / CHECKPOINT_ROOT_FIXED) return ck_invalid(c, "bad root count");
+
+    c->nroots = (size_t)nroots;
+    c->roots = (RootInfo *)du_calloc(&c->alloc, c->nroots ? c->nroots : 1, sizeof(RootInfo));
+    if (!c->roots) {
+        ck_report(c, "out of memory", ENOMEM);
+        return 1;
+    }
+
+    size_t off = CHECKPOINT_HEADER_SIZE;
+    for (size_t i = 0; i < c->nroots; i++) {
+        RootInfo *r = &c->roots[i];
+        if (c->size - off < CHECKPOINT_ROOT_FIXED) return ck_invalid(c, "truncated root");
+        r->begin = off;
+        r->state = c->data[off];
+        memcpy(&r->status, c->data + off + 4, 4);
+        r->bytes = get_u64(c->data + off + 8);
+        r->path_len = get_u32(c->data + off + 16);
+        off += CHECKPOINT_ROOT_FIXED;
+        if (r->state > CHECKPOINT_DONE || c->size - off < r->path_len) return ck_invalid(c, "bad root");
+        r->path = c->data + off;
+        off += r->path_len;
+        if (r->state == CHECKPOINT_RUNNING && ck_parse_running(c, r, &off) != 0) return 2;
+        r->end = off;
+    }
+    if (off != c->size) return ck_invalid(c, "trailing data");
+    return 0;
+}
+
+Checkpoint *checkpoint_open(const char *path, const DuAllocator *a, const DuCallbacks *cb) {
+    Checkpoint *c = (Checkpoint *)du_calloc(a, 1, sizeof(Checkpoint));
+    if (!c) {
+        if (cb && cb->on_error) cb->on_error(cb->user, "out of memory", path, ENOMEM);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (a) c->alloc = *a;
+    if (cb) c->cb = *cb;
+    c->path = path;
+    if (ck_load(c) != 0) {
+        int err = errno;
+        checkpoint_close(c);
+        errno = err;
+        return NULL;
+    }
+    return c;
+}
+
+void checkpoint_close(Checkpoint *c) {
+    if (!c) return;
+    if (c->data && c->size) munmap((void *)c->data, c->size);
+    DuAllocator a = c->alloc;
+    du_free(&a, c->roots);
+    du_free(&a, c);
+}
+
+bool checkpoint_matches(const Checkpoint *c, const char *const *roots, size_t n) {
+    if (c->nroots != n) return false;
+    for (size_t i = 0; i < n; i++) {
+        const RootInfo *r = &c->roots[i];
+        if (strlen(roots[i]) != r->path_len || memcmp(roots[i], r->path, r->path_len) != 0) return false;
+    }
+    return true;
+}
+
+void checkpoint_root(const Checkpoint *c, size_t i, CheckpointRoot *out) {
+    const RootInfo *r = &c->roots[i];
+    out->state = r->state;
+    out->status = r->status;
+    out->bytes = r->bytes;
+}
+
+void checkpoint_write_copy(CheckpointWriter *w, const Checkpoint *c, size_t i) {
+    const RootInfo *r = &c->roots[i];
+    put(w, c->data + r->begin, r->end - r->begin);
+}
+
+int checkpoint_load_inodes(const Checkpoint *c, size_t i, InodeSet *seen) {
+    const RootInfo *r = &c->roots[i];
+    if (r->state != CHECKPOINT_RUNNING) return 0;
+
+    const unsigned char *p = c->data + r->inodes;
+    uint64_t left = get_u64(p);
+    p += 8;
+    while (left > 0) {
+        InodeKey k = {.dev = (dev_t)get_u64(p)};
+        uint32_t n = get_u32(p + 8);
+        p += CHECKPOINT_RUN_FIXED;
+        for (uint32_t j = 0; j < n; j++, p += 8) {
+            bool oom = false;
+            k.ino = (ino_t)get_u64(p);
+            inode_set_insert(seen, k, &oom);
+            if (oom) return -1;
+        }
+        left -= n;
+    }
+    return 0;
+}
+
+bool checkpoint_next_task(const Checkpoint *c, size_t i, size_t *pos, CheckpointTask *out) {
+    const RootInfo *r = &c->roots[i];
+    if (r->state != CHECKPOINT_RUNNING) return false;
+
+    size_t o = (*pos == 0) ? r->tasks + 8 : *pos;
+    if (o >= r->end) return false;
+    out->kind = c->data[o];
+    out->prio = get_u64(c->data + o + 1);
+    out->path_len = get_u32(c->data + o + 9);
+    out->path = (const char *)c->data + o + CHECKPOINT_TASK_FIXED;
+    *pos = o + CHECKPOINT_TASK_FIXED + out->path_len;
+    return true;
+}
@@ -0,0 +1,34 @@
+#include "du_alloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int has_hooks(const DuAllocator *a) {
+    return a && a->alloc_fn && a->realloc_fn && a->free_fn;
+}
+
+void *du_malloc(const DuAllocator *a, size_t size) {
+    if (has_hooks(a)) return a->alloc_fn(a->user, size);
+    return malloc(size);
+}
+
+void *du_calloc(const DuAllocator *a, size_t n, size_t size) {
+    if (!has_hooks(a)) return calloc(n, size);
+    if (size != 0 && n > SIZE_MAX / size) return NULL;
+
+    void *p = a->alloc_fn(a->user, n * size);
+    if (p) memset(p, 0, n * size);
+    return p;
+}
+
+void *du_realloc(const DuAllocator *a, void *ptr, size_t size) {
+    if (has_hooks(a)) return a->realloc_fn(a->user, ptr, size);
+    return realloc(ptr, size);
+}
+
+void du_free(const DuAllocator *a, void *ptr) {
+    if (!ptr) return;
+    if (has_hooks(a)) a->free_fn(a->user, ptr);
+    else free(ptr);
+}
@@ -3,13 +3,18 @@
 
 #include "du_sync.h"
 
+#include "checkpoint.h"
 #include "inode_set.h"
+#include "manifest.h"
 #include "path_util.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,6 +22,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 static unsigned long long get_tid_ull(void) {
@@ -27,8 +33,64 @@ static unsigned long long get_tid_ull(void) {
 #endif
 }
 
-static void dbg_threads(const DuOptions *opt, const char *fmt, ...) {
-    if (!opt || !opt->debug_threads) return;
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Progress counters of one thread. Each slot has a single writer, so updates
+ * are relaxed load+store pairs (no locked instructions); readers may see a
+ * slightly stale but never torn value.
+ */
+typedef struct CounterSlot {
+    _Alignas(64) atomic_uint_fast64_t dirs;
+    atomic_uint_fast64_t files;
+    atomic_uint_fast64_t bytes;
+} CounterSlot;
+
+/* Slot 0 belongs to the calling thread, slot i + 1 to parallel worker i. */
+typedef struct Counters {
+    atomic_uint_fast64_t queued; /* directories waiting to be read */
+    atomic_uint_fast64_t peak_queued;
+    size_t nslots;
+    CounterSlot *slots; /* cache-line aligned view of slots_mem */
+    void *slots_mem;
+} Counters;
+
+struct DuScan {
+    DuOptions opt;
+    DuCallbacks cb;
+    DuAllocator alloc;
+    ManifestWriter *manifest; /* not owned; NULL when not recording */
+    Counters *counters;       /* NULL unless progress is enabled */
+    size_t peak_queued;       /* largest frontier of all runs so far */
+    const ManifestSizes *history; /* not owned; NULL when not set */
+    const char *ckpt_path;        /* not owned; NULL when not checkpointing */
+    double ckpt_interval;
+    const Checkpoint *resume; /* not owned; NULL when starting afresh */
+    struct Throttle *throttle; /* NULL unless rate limits or backoff are set */
+};
+
+/* Per-thread sinks: one for the sequential scan, one per parallel worker. */
+typedef struct ScanLocal {
+    GroupMap *groups;     /* merged when the root completes; NULL when not grouping */
+    ManifestBlock *mblk;  /* staged manifest records */
+    CounterSlot *ctr;     /* NULL unless progress is enabled */
+    size_t root;          /* index of the root being scanned, for DuEntry.root */
+} ScanLocal;
+
+/* A directory waiting to be read. */
+typedef struct DirItem {
+    char *path;
+    uint64_t id;    /* manifest dir id, 0 when not recording */
+    uint64_t hist;  /* id of the same directory in the scan history, 0 if unknown */
+    uint32_t level; /* depth below the root (0: the root) */
+} DirItem;
+
+static void dbg_threads(const DuScan *scan, const char *fmt, ...) {
+    if (!scan->opt.debug_threads) return;
 
     va_list ap;
     va_start(ap, fmt);
@@ -38,20 +100,386 @@ static void dbg_threads(const DuOptions *opt, const char *fmt, ...) {
     va_end(ap);
 }
 
-static void warn_errno(const DuOptions *opt, const char *msg, const char *path) {
-    if (opt && opt->quiet) return;
-    fprintf(stderr, "du-sync: %s: %s: %s\n", msg, path, strerror(errno));
+static void warn_errno(const DuScan *scan, const char *msg, const char *path) {
+    int err = errno;
+    if (scan->cb.on_error) {
+        scan->cb.on_error(scan->cb.user, msg, path, err);
+        return;
+    }
+    if (scan->opt.quiet) return;
+    fprintf(stderr, "du-sync: %s: %s: %s\n", msg, path, strerror(err));
+}
+
+static DuEntryKind entry_kind(const struct stat *st) {
+    if (S_ISREG(st->st_mode)) return DU_ENTRY_FILE;
+    if (S_ISDIR(st->st_mode)) return DU_ENTRY_DIR;
+    return DU_ENTRY_OTHER;
+}
+
+static CounterSlot *counter_slot(const DuScan *scan, size_t idx) {
+    return scan->counters ? &scan->counters->slots[idx] : NULL;
+}
+
+static void counter_add(atomic_uint_fast64_t *c, uint64_t v) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+/* Counts one regular file (and its bytes if it was counted). */
+static void progress_file(ScanLocal *local, bool counted, const struct stat *st) {
+    if (!local->ctr) return;
+    counter_add(&local->ctr->files, 1);
+    if (counted) counter_add(&local->ctr->bytes, (uint64_t)st->st_size);
+}
+
+static void progress_dir(ScanLocal *local) {
+    if (local->ctr) counter_add(&local->ctr->dirs, 1);
+}
+
+/* ---------------- Throttling ---------------- */
+
+#define THROTTLE_BURST_NS 100000000LL  /* a bucket holds 100ms worth of tokens */
+#define THROTTLE_ADJUST_NS 100000000LL /* backoff changes at most this often */
+#define THROTTLE_BACKOFF_MAX 16
+
+/*
+ * Each token bucket is one atomic timestamp: the time at which the tokens
+ * handed out so far are paid for (GCRA). A caller advances it by one token's
+ * cost with a CAS and sleeps until it is no more than a burst ahead, so
+ * workers share a rate limit without a lock.
+ */
+typedef struct Throttle {
+    int64_t stat_cost; /* ns per token; 0: unlimited */
+    int64_t dir_cost;
+    int64_t slow_ns; /* backoff threshold; 0: none */
+    atomic_int_fast64_t stat_due;
+    atomic_int_fast64_t dir_due;
+
+    atomic_int_fast64_t avg_ns;      /* moving average of stat latency (racy updates are fine) */
+    atomic_int_fast64_t next_adjust; /* when backoff may change next */
+    atomic_int backoff;              /* each stat is followed by a pause of backoff x avg_ns */
+} Throttle;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_ns(int64_t ns) {
+    struct timespec ts = {.tv_sec = (time_t)(ns / 1000000000LL), .tv_nsec = (long)(ns % 1000000000LL)};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static void bucket_take(atomic_int_fast64_t *due, int64_t cost) {
+    if (cost == 0) return;
+    int64_t burst = cost > THROTTLE_BURST_NS ? cost : THROTTLE_BURST_NS;
+    int64_t now = now_ns();
+    int64_t old = atomic_load_explicit(due, memory_order_relaxed);
+    int64_t next;
+    do {
+        next = (old > now ? old : now) + cost;
+    } while (!atomic_compare_exchange_weak_explicit(due, &old, next, memory_order_relaxed, memory_order_relaxed));
+    if (next - burst > now) sleep_ns(next - burst - now);
+}
+
+/*
+ * Folds one stat latency into the average. Every THROTTLE_ADJUST_NS one caller
+ * doubles the backoff while the average is above the threshold and lowers it
+ * by one once it is below; then every caller pauses for backoff x average.
+ */
+static void backoff_note(Throttle *t, int64_t lat, int64_t now) {
+    int64_t avg = atomic_load_explicit(&t->avg_ns, memory_order_relaxed);
+    avg += (lat - avg) / 16;
+    atomic_store_explicit(&t->avg_ns, avg, memory_order_relaxed);
+
+    int64_t when = atomic_load_explicit(&t->next_adjust, memory_order_relaxed);
+    if (now >= when && atomic_compare_exchange_strong_explicit(&t->next_adjust, &when, now + THROTTLE_ADJUST_NS,
+                                                               memory_order_relaxed, memory_order_relaxed)) {
+        int b = atomic_load_explicit(&t->backoff, memory_order_relaxed);
+        if (avg > t->slow_ns) b = b ? (b * 2 < THROTTLE_BACKOFF_MAX ? b * 2 : THROTTLE_BACKOFF_MAX) : 1;
+        else if (b > 0) b--;
+        atomic_store_explicit(&t->backoff, b, memory_order_relaxed);
+    }
+
+    int b = atomic_load_explicit(&t->backoff, memory_order_relaxed);
+    if (b > 0) sleep_ns((int64_t)b * avg);
+}
+
+/* lstat/fstatat (dfd >= 0) under the scan's throttle. */
+static int throttled_stat(const DuScan *scan, int dfd, const char *path, struct stat *st) {
+    Throttle *t = scan->throttle;
+    if (!t) return dfd >= 0 ? fstatat(dfd, path, st, AT_SYMLINK_NOFOLLOW) : lstat(path, st);
+
+    bucket_take(&t->stat_due, t->stat_cost);
+    int64_t start = t->slow_ns ? now_ns() : 0;
+    int rc = dfd >= 0 ? fstatat(dfd, path, st, AT_SYMLINK_NOFOLLOW) : lstat(path, st);
+    if (t->slow_ns) {
+        int err = errno;
+        int64_t end = now_ns();
+        backoff_note(t, end - start, end);
+        errno = err;
+    }
+    return rc;
+}
+
+static int scan_lstat(const DuScan *scan, const char *path, struct stat *st) {
+    return throttled_stat(scan, -1, path, st);
+}
+
+static DIR *scan_opendir(const DuScan *scan, const char *path) {
+    if (scan->throttle) bucket_take(&scan->throttle->dir_due, scan->throttle->dir_cost);
+    return opendir(path);
+}
+
+/* Called by the single thread (or under the lock) that changes the frontier. */
+static void progress_queued(const DuScan *scan, size_t depth) {
+    Counters *c = scan->counters;
+    if (!c) return;
+    atomic_store_explicit(&c->queued, depth, memory_order_relaxed);
+    if (depth > atomic_load_explicit(&c->peak_queued, memory_order_relaxed))
+        atomic_store_explicit(&c->peak_queued, depth, memory_order_relaxed);
+}
+
+/* Reports an entry to the visitor. Returns 0 to continue, 1 if it ran out of memory, 3 if it aborted. */
+static int visit_entry(const DuScan *scan, const ScanLocal *local, const char *path, const struct stat *st,
+                       bool counted) {
+    if (!scan->cb.on_entry) return 0;
+    DuEntry e = {.kind = entry_kind(st), .path = path, .st = st, .counted = counted, .root = local->root};
+    int rc = scan->cb.on_entry(scan->cb.user, &e);
+    if (rc == 0) return 0;
+    return (rc == DU_ENTRY_NOMEM) ? 1 : 3;
+}
+
+/* ---------------- Group-by aggregation ---------------- */
+
+static const char *const AGE_BUCKET_NAMES[] = {"<1d", "1d-7d", "7d-30d", "30d-90d", "90d-1y", ">1y"};
+static const int64_t AGE_BUCKET_LIMITS[] = {86400, 7 * 86400, 30 * 86400, 90 * 86400, 365 * 86400};
+
+static uint64_t age_bucket(time_t now, time_t mtime) {
+    int64_t age = (int64_t)now - (int64_t)mtime;
+    uint64_t b = 0;
+    while (b < sizeof(AGE_BUCKET_LIMITS) / sizeof(AGE_BUCKET_LIMITS[0]) && age >= AGE_BUCKET_LIMITS[b]) b++;
+    return b;
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/* Extension of a file name without the dot; dotfiles like ".bashrc" have none. */
+static const char *ext_of(const char *name, size_t *len) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name) {
+        *len = 0;
+        return name;
+    }
+    *len = strlen(dot + 1);
+    return dot + 1;
+}
+
+/* Adds a counted regular file to its group. No-op when groups is NULL. */
+static int group_add(GroupMap *groups, const DuOptions *opt, time_t now, const char *name,
+                     const struct stat *st) {
+    if (!groups) return 0;
+
+    uint64_t bytes = (uint64_t)st->st_size;
+    switch (opt->group_by) {
+        case DU_GROUP_UID:
+            return group_map_add_id(groups, (uint64_t)st->st_uid, bytes);
+        case DU_GROUP_GID:
+            return group_map_add_id(groups, (uint64_t)st->st_gid, bytes);
+        case DU_GROUP_EXT: {
+            size_t len = 0;
+            const char *ext = ext_of(name, &len);
+            return group_map_add_name(groups, ext, len, bytes);
+        }
+        case DU_GROUP_AGE:
+            return group_map_add_id(groups, age_bucket(now, st->st_mtime), bytes);
+        case DU_GROUP_NONE:
+        default:
+            return 0;
+    }
+}
+
+const char *du_sync_age_bucket_name(uint64_t bucket) {
+    size_t n = sizeof(AGE_BUCKET_NAMES) / sizeof(AGE_BUCKET_NAMES[0]);
+    return (bucket < n) ? AGE_BUCKET_NAMES[(size_t)bucket] : "?";
+}
+
+/* ---------------- Manifest records ---------------- */
+
+static uint64_t manifest_dir_id(const DuScan *scan) {
+    return scan->manifest ? manifest_new_dir_id(scan->manifest) : 0;
+}
+
+/* Stages a manifest record for an entry. Returns 0, or 1 on OOM. */
+static int manifest_note(const DuScan *scan, ScanLocal *local, uint8_t type, bool counted, uint64_t id,
+                         uint64_t parent, const char *name, const struct stat *st) {
+    if (!scan->manifest) return 0;
+
+    ManifestRecord r = {
+        .type = type,
+        .flags = (uint8_t)((counted ? MANIFEST_COUNTED : 0) | (st->st_nlink > 1 ? MANIFEST_MULTI_LINK : 0)),
+        .id = id,
+        .parent = parent,
+        .size = (uint64_t)st->st_size,
+        .dev = (uint64_t)st->st_dev,
+        .ino = (uint64_t)st->st_ino,
+        .mtime = (int64_t)st->st_mtime,
+        .name = name,
+        .name_len = strlen(name),
+    };
+    return (manifest_append(scan->manifest, &local->mblk, &r) == 0) ? 0 : 1;
+}
+
+static void scan_local_flush(const DuScan *scan, ScanLocal *local) {
+    if (scan->manifest) manifest_flush(scan->manifest, &local->mblk);
+}
+
+/* ---------------- Checkpoints ---------------- */
+
+typedef struct CkptResult {
+    bool done;
+    int status;
+    uint64_t bytes;
+} CkptResult;
+
+/*
+ * Checkpointing state of one du_scan_run_many: the results delivered so far,
+ * which every save repeats, and the checkpoint being resumed, whose sections
+ * are copied for roots not started yet.
+ */
+typedef struct CkptRun {
+    const DuScan *scan;
+    const char *const *roots;
+    size_t n;
+    size_t cur;          /* sequential: root being scanned */
+    CkptResult *results; /* per root; NULL when not saving */
+    const Checkpoint *resume;
+    double next; /* monotonic time of the next save */
+} CkptRun;
+
+/* Returns 0, 1 on OOM, 2 if checkpoints cannot be used for this run. */
+static int ckpt_init(CkptRun *ck, const DuScan *scan, const char *const *roots, size_t n) {
+    memset(ck, 0, sizeof(*ck));
+    ck->scan = scan;
+    ck->roots = roots;
+    ck->n = n;
+    ck->resume = scan->resume;
+    if (!scan->ckpt_path && !scan->resume) return 0;
+
+    if (scan->opt.group_by != DU_GROUP_NONE || scan->manifest || scan->opt.shard_count > 1) return 2;
+    if (scan->resume && !checkpoint_matches(scan->resume, roots, n)) return 2;
+    if (scan->ckpt_path) {
+        ck->results = (CkptResult *)du_calloc(&scan->alloc, n, sizeof(CkptResult));
+        if (!ck->results) return 1;
+        ck->next = now_seconds() + scan->ckpt_interval;
+    }
+    return 0;
+}
+
+/* After a successful run the checkpoint is obsolete. */
+static void ckpt_finish(CkptRun *ck, int rc) {
+    if (ck->results && rc == 0 && unlink(ck->scan->ckpt_path) != 0 && errno != ENOENT)
+        warn_errno(ck->scan, "cannot remove checkpoint", ck->scan->ckpt_path);
+    du_free(&ck->scan->alloc, ck->results);
+    ck->results = NULL;
+}
+
+static bool ckpt_due(const CkptRun *ck) {
+    return ck->results && now_seconds() >= ck->next;
+}
+
+static void ckpt_state(const CkptRun *ck, size_t i, CheckpointRoot *out) {
+    if (ck->resume) checkpoint_root(ck->resume, i, out);
+    else *out = (CheckpointRoot){.state = CHECKPOINT_PENDING, .status = 0, .bytes = 0};
+}
+
+static void ckpt_delivered(CkptRun *ck, size_t i, int status, uint64_t bytes) {
+    if (ck->results) ck->results[i] = (CkptResult){.done = true, .status = status, .bytes = bytes};
+}
+
+static CheckpointWriter *ckpt_begin(CkptRun *ck) {
+    CheckpointWriter *w = checkpoint_writer_open(ck->scan->ckpt_path, ck->n, &ck->scan->alloc);
+    if (!w) warn_errno(ck->scan, "cannot write checkpoint", ck->scan->ckpt_path);
+    return w;
+}
+
+/* Writes the section of a root that is not in flight: delivered, resumed or not started. */
+static void ckpt_put_idle_root(CkptRun *ck, CheckpointWriter *w, size_t i) {
+    const CkptResult *res = &ck->results[i];
+    if (res->done) checkpoint_write_root(w, CHECKPOINT_DONE, res->status, res->bytes, ck->roots[i]);
+    else if (ck->resume) checkpoint_write_copy(w, ck->resume, i);
+    else checkpoint_write_root(w, CHECKPOINT_PENDING, 0, 0, ck->roots[i]);
+}
+
+static void ckpt_end(CkptRun *ck, CheckpointWriter *w) {
+    if (checkpoint_writer_close(w) != 0) warn_errno(ck->scan, "cannot write checkpoint", ck->scan->ckpt_path);
+    else dbg_threads(ck->scan, "checkpoint path=%s", ck->scan->ckpt_path);
+    ck->next = now_seconds() + ck->scan->ckpt_interval;
+}
+
+/* Saves the run between two roots, when none is in flight. */
+static void ckpt_save_idle(CkptRun *ck) {
+    CheckpointWriter *w = ckpt_begin(ck);
+    if (!w) return;
+    for (size_t i = 0; i < ck->n; i++) ckpt_put_idle_root(ck, w, i);
+    ckpt_end(ck, w);
+}
+
+/* Copies the path of a saved task into a new string. Returns NULL on OOM. */
+static char *ckpt_task_path(const DuAllocator *a, const CheckpointTask *t) {
+    char *p = (char *)du_malloc(a, t->path_len + 1);
+    if (!p) return NULL;
+    memcpy(p, t->path, t->path_len);
+    p[t->path_len] = '\0';
+    return p;
+}
+
+/* ---------------- Sharding ---------------- */
+
+/* FNV-1a of the last `level` components of path, i.e. of its path below the root, so every host agrees. */
+static uint64_t shard_hash(const char *path, uint32_t level) {
+    const char *p = path + strlen(path);
+    for (uint32_t n = 0; p > path; p--) {
+        if (p[-1] == '/' && ++n == level) break;
+    }
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static bool shard_valid(const DuOptions *opt) {
+    return opt->shard_count <= 1 || (opt->shard_index < opt->shard_count && opt->shard_level >= 1);
+}
+
+/* Whether this shard reads directory `path`, `level` below the root (deeper ones are only reached by their owner). */
+static bool shard_owns_dir(const DuOptions *opt, const char *path, uint32_t level) {
+    if (opt->shard_count <= 1 || level != opt->shard_level) return true;
+    return shard_hash(path, level) % opt->shard_count == opt->shard_index;
+}
+
+/* Whether this shard counts the entries other than directories of a directory at parent_level. */
+static bool shard_owns_entries(const DuOptions *opt, uint32_t parent_level) {
+    return opt->shard_count <= 1 || parent_level >= opt->shard_level || opt->shard_index == 0;
 }
 
 /* ---------------- Sequential traversal (iterative stack) ---------------- */
 
 typedef struct PathStack {
-    char **items;
+    const DuAllocator *alloc;
+    DirItem *items;
     size_t len;
     size_t cap;
 } PathStack;
 
-static void stack_init(PathStack *s) {
+static void stack_init(PathStack *s, const DuAllocator *a) {
+    s->alloc = a;
     s->items = NULL;
     s->len = 0;
     s->cap = 0;
@@ -59,86 +487,93 @@ static void stack_init(PathStack *s) {
 
 static void stack_destroy(PathStack *s) {
     if (!s) return;
-    for (size_t i = 0; i < s->len; i++) free(s->items[i]);
-    free(s->items);
+    for (size_t i = 0; i < s->len; i++) du_free(s->alloc, s->items[i].path);
+    du_free(s->alloc, s->items);
     s->items = NULL;
     s->len = 0;
     s->cap = 0;
 }
 
-static int stack_push(PathStack *s, char *path) {
+static int stack_push(PathStack *s, DirItem item) {
     if (s->len == s->cap) {
         size_t new_cap = (s->cap == 0) ? 16 : s->cap * 2;
-        char **p = (char **)realloc(s->items, new_cap * sizeof(char *));
+        DirItem *p = (DirItem *)du_realloc(s->alloc, s->items, new_cap * sizeof(DirItem));
         if (!p) return -1;
         s->items = p;
         s->cap = new_cap;
     }
-    s->items[s->len++] = path;
+    s->items[s->len++] = item;
     return 0;
 }
 
-static char *stack_pop(PathStack *s) {
-    if (s->len == 0) return NULL;
-    return s->items[--s->len];
+static bool stack_pop(PathStack *s, DirItem *out) {
+    if (s->len == 0) return false;
+    *out = s->items[--s->len];
+    return true;
 }
 
-static int inode_add_once(InodeSet *seen, const struct stat *st, uint64_t *acc) {
+static int inode_add_once(InodeSet *seen, const struct stat *st, uint64_t *acc, bool *inserted_out) {
     InodeKey k = {.dev = st->st_dev, .ino = st->st_ino};
     bool oom = false;
     bool inserted = inode_set_insert(seen, k, &oom);
     if (oom) return -1;
     if (inserted) *acc += (uint64_t)st->st_size;
+    *inserted_out = inserted;
     return 0;
 }
 
-static int du_sync_sum_regular_bytes_sequential(const char *root_path, const DuOptions *opt,
-                                                uint64_t *out_bytes) {
-    *out_bytes = 0;
-
-    InodeSet *seen = inode_set_create();
-    if (!seen) return 1;
-
-    PathStack st;
-    stack_init(&st);
-
-    struct stat sb;
-    if (lstat(root_path, &sb) != 0) {
-        warn_errno(opt, "cannot stat", root_path);
-        inode_set_destroy(seen);
-        stack_destroy(&st);
-        return 0;
-    }
+/* Counts a regular file once and reports it. Returns 0, 1 on OOM or 3 if the visitor aborted. */
+static int count_regular_sequential(const DuScan *scan, InodeSet *seen, time_t now, const char *path,
+                                    const char *name, const struct stat *st, uint64_t dir_id, uint64_t *acc,
+                                    ScanLocal *local) {
+    bool inserted = false;
+    if (inode_add_once(seen, st, acc, &inserted) != 0) return 1;
+    progress_file(local, inserted, st);
+    if (inserted && group_add(local->groups, &scan->opt, now, name, st) != 0) return 1;
+    if (manifest_note(scan, local, MANIFEST_FILE, inserted, dir_id, 0, name, st) != 0) return 1;
+    return visit_entry(scan, local, path, st, inserted);
+}
 
-    if (S_ISREG(sb.st_mode)) {
-        int rc = inode_add_once(seen, &sb, out_bytes);
-        inode_set_destroy(seen);
-        stack_destroy(&st);
-        return (rc == 0) ? 0 : 1;
-    }
+/* Saves the run with the sequential scan of root ck->cur at a directory boundary. */
+static void ckpt_save_sequential(CkptRun *ck, const InodeSet *seen, uint64_t bytes, const PathStack *st) {
+    CheckpointWriter *w = ckpt_begin(ck);
+    if (!w) return;
 
-    if (!S_ISDIR(sb.st_mode)) {
-        inode_set_destroy(seen);
-        stack_destroy(&st);
-        return 0;
+    for (size_t i = 0; i < ck->n; i++) {
+        if (i != ck->cur) {
+            ckpt_put_idle_root(ck, w, i);
+            continue;
+        }
+        checkpoint_write_root(w, CHECKPOINT_RUNNING, 0, bytes, ck->roots[i]);
+        checkpoint_write_inodes(w, seen);
+        checkpoint_write_task_count(w, st->len);
+        for (size_t k = 0; k < st->len; k++) checkpoint_write_task(w, CHECKPOINT_TASK_DIR, 0, st->items[k].path);
     }
+    ckpt_end(ck, w);
+}
 
-    char *root_copy = xstrdup(root_path);
-    if (!root_copy || stack_push(&st, root_copy) != 0) {
-        free(root_copy);
-        inode_set_destroy(seen);
-        stack_destroy(&st);
-        return 1;
-    }
+/*
+ * Reads the stacked directories depth-first until the stack is empty. With ck,
+ * the run is saved between two directories whenever a checkpoint is due.
+ */
+static int walk_sequential(const DuScan *scan, InodeSet *seen, PathStack *st, time_t now, uint64_t *out_bytes,
+                           ScanLocal *local, size_t *peak, CkptRun *ck) {
+    const DuAllocator *a = &scan->alloc;
+    int rc = 0;
 
     for (;;) {
-        char *dirpath = stack_pop(&st);
-        if (!dirpath) break;
+        if (ck && st->len > 0 && ckpt_due(ck)) ckpt_save_sequential(ck, seen, *out_bytes, st);
 
-        DIR *dir = opendir(dirpath);
+        DirItem item;
+        if (!stack_pop(st, &item)) break;
+        char *dirpath = item.path;
+        progress_dir(local);
+        progress_queued(scan, st->len);
+
+        DIR *dir = scan_opendir(scan, dirpath);
         if (!dir) {
-            warn_errno(opt, "cannot open directory", dirpath);
-            free(dirpath);
+            warn_errno(scan, "cannot open directory", dirpath);
+            du_free(a, dirpath);
             continue;
         }
 
@@ -147,378 +582,1759 @@ static int du_sync_sum_regular_bytes_sequential(const char *root_path, const DuO
             const char *name = de->d_name;
             if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
 
-            char *child = path_join(dirpath, name);
+            char *child = path_join_with(a, dirpath, name);
             if (!child) {
-                closedir(dir);
-                free(dirpath);
-                inode_set_destroy(seen);
-                stack_destroy(&st);
-                return 1;
+                rc = 1;
+                break;
             }
 
             struct stat csb;
-            if (lstat(child, &csb) != 0) {
-                warn_errno(opt, "cannot stat", child);
-                free(child);
+            if (scan_lstat(scan, child, &csb) != 0) {
+                warn_errno(scan, "cannot stat", child);
+                du_free(a, child);
+                errno = 0;
                 continue;
             }
 
-            if (S_ISDIR(csb.st_mode)) {
-                if (stack_push(&st, child) != 0) {
-                    free(child);
-                    closedir(dir);
-                    free(dirpath);
-                    inode_set_destroy(seen);
-                    stack_destroy(&st);
-                    return 1;
-                }
+            if (S_ISDIR(csb.st_mode) && !shard_owns_dir(&scan->opt, child, item.level + 1)) {
+                du_free(a, child);
+                continue;
+            }
+            if (!S_ISDIR(csb.st_mode) && !shard_owns_entries(&scan->opt, item.level)) {
+                du_free(a, child);
                 continue;
             }
 
-            if (S_ISREG(csb.st_mode)) {
-                int rc = inode_add_once(seen, &csb, out_bytes);
-                free(child);
+            if (S_ISDIR(csb.st_mode)) {
+                DirItem sub = {.path = child, .id = manifest_dir_id(scan), .level = item.level + 1};
+                rc = visit_entry(scan, local, child, &csb, false);
+                if (rc == 0) rc = manifest_note(scan, local, MANIFEST_DIR, false, sub.id, item.id, name, &csb);
+                if (rc == 0 && stack_push(st, sub) != 0) rc = 1;
+                if (st->len > *peak) *peak = st->len;
                 if (rc != 0) {
-                    closedir(dir);
-                    free(dirpath);
-                    inode_set_destroy(seen);
-                    stack_destroy(&st);
-                    return 1;
+                    du_free(a, child);
+                    break;
                 }
                 continue;
             }
 
-            free(child);
+            if (S_ISREG(csb.st_mode))
+                rc = count_regular_sequential(scan, seen, now, child, name, &csb, item.id, out_bytes, local);
+            else rc = visit_entry(scan, local, child, &csb, false);
+            du_free(a, child);
+            if (rc != 0) break;
         }
 
-        if (errno != 0) warn_errno(opt, "error reading directory", dirpath);
+        if (rc == 0 && errno != 0) warn_errno(scan, "error reading directory", dirpath);
 
         closedir(dir);
-        free(dirpath);
+        du_free(a, dirpath);
+        if (rc != 0) break;
     }
+    return rc;
+}
 
-    inode_set_destroy(seen);
-    stack_destroy(&st);
+/*
+ * Stats root_path and counts it if it is not a directory, or visits and stacks
+ * it otherwise. Returns 0 (also when the root cannot be stat'ed), 1 on OOM or 3.
+ */
+static int begin_root_sequential(const DuScan *scan, InodeSet *seen, const char *root_path, time_t now,
+                                 uint64_t *out_bytes, ScanLocal *local, PathStack *st) {
+    struct stat sb;
+    if (scan_lstat(scan, root_path, &sb) != 0) {
+        warn_errno(scan, "cannot stat", root_path);
+        return 0;
+    }
+
+    if (!S_ISDIR(sb.st_mode) && !shard_owns_entries(&scan->opt, 0)) return 0;
+
+    if (S_ISREG(sb.st_mode))
+        return count_regular_sequential(scan, seen, now, root_path, base_name(root_path), &sb, 0, out_bytes, local);
+    if (!S_ISDIR(sb.st_mode)) return visit_entry(scan, local, root_path, &sb, false);
+
+    DirItem root = {.path = NULL, .id = manifest_dir_id(scan)};
+    int rc = visit_entry(scan, local, root_path, &sb, false);
+    if (rc == 0) rc = manifest_note(scan, local, MANIFEST_DIR, false, root.id, 0, root_path, &sb);
+    if (rc != 0) return rc;
+
+    root.path = xstrdup_with(&scan->alloc, root_path);
+    if (!root.path || stack_push(st, root) != 0) {
+        du_free(&scan->alloc, root.path);
+        return 1;
+    }
     return 0;
 }
 
+/*
+ * Adds the bytes under root_path not yet in seen to *out_bytes; *peak is raised
+ * to the largest number of directories stacked at once. ck (may be NULL) saves
+ * checkpoints of root ck->cur.
+ */
+static int scan_tree_sequential(const DuScan *scan, InodeSet *seen, const char *root_path, uint64_t *out_bytes,
+                                GroupMap *groups, size_t *peak, CkptRun *ck) {
+    time_t now = time(NULL);
+    PathStack st;
+    stack_init(&st, &scan->alloc);
+    ScanLocal local = {.groups = groups, .mblk = NULL, .ctr = counter_slot(scan, 0), .root = ck ? ck->cur : 0};
+
+    int rc = begin_root_sequential(scan, seen, root_path, now, out_bytes, &local, &st);
+    if (rc == 0) rc = walk_sequential(scan, seen, &st, now, out_bytes, &local, peak, ck);
+
+    scan_local_flush(scan, &local);
+    stack_destroy(&st);
+    return rc;
+}
+
+/*
+ * Continues root ck->cur from its checkpoint section: hardlink set, total and
+ * pending tasks. A root task (saved by a parallel run before the root was
+ * stat'ed) starts the root as scan_tree_sequential does.
+ */
+static int resume_tree_sequential(const DuScan *scan, CkptRun *ck, InodeSet *seen, uint64_t *out_bytes,
+                                  size_t *peak) {
+    const DuAllocator *a = &scan->alloc;
+    time_t now = time(NULL);
+    PathStack st;
+    stack_init(&st, a);
+    ScanLocal local = {.groups = NULL, .mblk = NULL, .ctr = counter_slot(scan, 0), .root = ck->cur};
+
+    CheckpointRoot saved;
+    ckpt_state(ck, ck->cur, &saved);
+    *out_bytes = saved.bytes;
+
+    int rc = (checkpoint_load_inodes(ck->resume, ck->cur, seen) == 0) ? 0 : 1;
+    size_t pos = 0;
+    CheckpointTask t;
+    while (rc == 0 && checkpoint_next_task(ck->resume, ck->cur, &pos, &t)) {
+        DirItem item = {.path = ckpt_task_path(a, &t), .id = 0, .hist = 0};
+        if (!item.path) {
+            rc = 1;
+        } else if (t.kind == CHECKPOINT_TASK_ROOT) {
+            rc = begin_root_sequential(scan, seen, item.path, now, out_bytes, &local, &st);
+            du_free(a, item.path);
+        } else if (stack_push(&st, item) != 0) {
+            du_free(a, item.path);
+            rc = 1;
+        }
+    }
+    if (rc == 0) rc = walk_sequential(scan, seen, &st, now, out_bytes, &local, peak, ck);
+
+    scan_local_flush(scan, &local);
+    stack_destroy(&st);
+    return rc;
+}
+
+static int du_sync_sum_regular_bytes_sequential(const DuScan *scan, const char *root_path, uint64_t *out_bytes,
+                                                GroupMap *groups, size_t *peak) {
+    *out_bytes = 0;
+    InodeSet *seen = inode_set_create_with(&scan->alloc);
+    if (!seen) return 1;
+
+    int rc = scan_tree_sequential(scan, seen, root_path, out_bytes, groups, peak, NULL);
+    inode_set_destroy(seen);
+    return rc;
+}
+
+/* Root i of a sequential du_scan_run_many: taken from the resumed checkpoint, continued from it, or scanned. */
+static int run_root_sequential(const DuScan *scan, CkptRun *ck, size_t i, uint64_t *out_bytes, GroupMap *groups,
+                               size_t *peak) {
+    CheckpointRoot saved;
+    ckpt_state(ck, i, &saved);
+    *out_bytes = 0;
+    if (saved.state == CHECKPOINT_DONE) {
+        *out_bytes = saved.bytes;
+        return saved.status;
+    }
+
+    InodeSet *seen = inode_set_create_with(&scan->alloc);
+    if (!seen) return 1;
+
+    ck->cur = i;
+    int rc;
+    if (saved.state == CHECKPOINT_RUNNING) rc = resume_tree_sequential(scan, ck, seen, out_bytes, peak);
+    else rc = scan_tree_sequential(scan, seen, ck->roots[i], out_bytes, groups, peak, ck);
+    inode_set_destroy(seen);
+    return rc;
+}
+
 /* ---------------- Parallel traversal (work queue + pthreads) ---------------- */
 
-typedef struct DirNode {
+/*
+ * One worker pool serves every root of a run. Each root in flight occupies a
+ * slot holding its own hardlink set and total; at most `nslots` roots are in
+ * flight, and a slot is reused only after its root's result was delivered.
+ */
+typedef struct RootSlot {
+    size_t index; /* position in the roots array */
+    const char *path;
+    time_t now;
+
+    InodeSet *seen;
+    uint64_t total_bytes;
+    pthread_mutex_t mu; /* seen, total_bytes */
+
+    size_t outstanding; /* queued + running tasks of this root, under WorkQueue.mu */
+    int complete;       /* under SharedState.res_mu */
+    struct RootSlot *next_done;
+    GroupMap *groups; /* result of the merged per-worker maps; NULL when not grouping */
+} RootSlot;
+
+/*
+ * A directory split across workers (more than opt.split_entries entries): its
+ * owner keeps reading names and hands out chunks of them; any worker stats them
+ * relative to the shared fd. The last reference closes the fd.
+ */
+typedef struct DirShare {
+    atomic_int refs;
+    atomic_int inflight; /* chunks queued or being processed by other workers */
+    int fd;              /* dup of the owner's directory fd */
     char *path;
-    struct DirNode *next;
+    uint64_t id;
+    uint64_t hist;
+    uint32_t level;
+} DirShare;
+
+#define CHUNK_NAMES 1024
+#define CHUNK_BYTES ((size_t)32 << 10)
+
+typedef struct DirChunk {
+    DirShare *dir;
+    size_t count;
+    size_t used;
+    char names[]; /* count NUL-terminated names, back to back */
+} DirChunk;
+
+static DirShare *dir_share_open(const DuAllocator *a, int dfd, const DirItem *item) {
+    DirShare *sh = (DirShare *)du_calloc(a, 1, sizeof(DirShare));
+    if (!sh) return NULL;
+    sh->path = xstrdup_with(a, item->path);
+    sh->fd = fcntl(dfd, F_DUPFD_CLOEXEC, 0);
+    if (!sh->path || sh->fd < 0) {
+        if (sh->fd >= 0) close(sh->fd);
+        du_free(a, sh->path);
+        du_free(a, sh);
+        return NULL;
+    }
+    sh->id = item->id;
+    sh->hist = item->hist;
+    sh->level = item->level;
+    atomic_init(&sh->refs, 1);
+    atomic_init(&sh->inflight, 0);
+    return sh;
+}
+
+static void dir_share_release(const DuAllocator *a, DirShare *sh) {
+    if (!sh || atomic_fetch_sub(&sh->refs, 1) != 1) return;
+    close(sh->fd);
+    du_free(a, sh->path);
+    du_free(a, sh);
+}
+
+typedef enum TaskKind {
+    TASK_DIR = 0,
+    TASK_ROOT,  /* item.path is the root itself and has not been stat'ed yet */
+    TASK_CHUNK, /* names of a split directory */
+} TaskKind;
+
+typedef struct DirNode {
+    DirItem item;
+    RootSlot *root;
+    TaskKind kind;
+    DirChunk *chunk; /* TASK_CHUNK */
+    uint64_t prio;   /* estimated work; larger runs first */
+    uint64_t seq;    /* push order, breaks ties first-in first-out */
 } DirNode;
 
+/* Tasks are kept in a binary max-heap on (prio, -seq). */
 typedef struct WorkQueue {
-    DirNode *head;
-    DirNode *tail;
-    size_t pending; /* queued dirs */
-    size_t active;  /* workers currently processing a dir */
-    int done;       /* all work complete OR fatal stop */
+    const DuScan *scan;
+    const DuAllocator *alloc;
+    DirNode *heap;
+    size_t heap_cap;
+    uint64_t seq;
+    size_t pending;      /* queued tasks */
+    size_t peak;         /* largest pending */
+    size_t cap;          /* subdirectories are read inline while pending >= cap; 0: unbounded */
+    atomic_size_t depth; /* mirror of pending for lock-free cap checks */
+    int shutdown;        /* no more roots will be admitted: exit once the queue is empty */
+    int status;          /* first fatal status (1 OOM, 3 aborted): workers stop */
+    size_t nchunks;      /* queued TASK_CHUNK tasks */
+    size_t active;       /* tasks being processed */
+    atomic_int paused;   /* checkpoint: only chunks are handed out, subdirectories are queued */
     pthread_mutex_t mu;
     pthread_cond_t cv;
+    pthread_cond_t idle_cv; /* caller: paused and no task left running */
 } WorkQueue;
 
-static void wq_init(WorkQueue *q) {
-    q->head = NULL;
-    q->tail = NULL;
+static void wq_init(WorkQueue *q, const DuScan *scan) {
+    q->scan = scan;
+    q->alloc = &scan->alloc;
+    q->heap = NULL;
+    q->heap_cap = 0;
+    q->seq = 0;
     q->pending = 0;
+    q->peak = 0;
+    q->cap = scan->opt.max_queued;
+    atomic_init(&q->depth, 0);
+    q->shutdown = 0;
+    q->status = 0;
+    q->nchunks = 0;
     q->active = 0;
-    q->done = 0;
+    atomic_init(&q->paused, 0);
     pthread_mutex_init(&q->mu, NULL);
     pthread_cond_init(&q->cv, NULL);
+    pthread_cond_init(&q->idle_cv, NULL);
 }
 
 static void wq_destroy(WorkQueue *q) {
     pthread_mutex_lock(&q->mu);
-    DirNode *cur = q->head;
-    while (cur) {
-        DirNode *n = cur->next;
-        free(cur->path);
-        free(cur);
-        cur = n;
-    }
-    q->head = q->tail = NULL;
+    for (size_t i = 0; i < q->pending; i++) {
+        DirNode *n = &q->heap[i];
+        if (n->chunk) dir_share_release(q->alloc, n->chunk->dir);
+        du_free(q->alloc, n->chunk);
+        du_free(q->alloc, n->item.path);
+    }
+    du_free(q->alloc, q->heap);
+    q->heap = NULL;
     q->pending = 0;
-    q->active = 0;
     pthread_mutex_unlock(&q->mu);
 
+    pthread_cond_destroy(&q->idle_cv);
     pthread_cond_destroy(&q->cv);
     pthread_mutex_destroy(&q->mu);
 }
 
-static int wq_push(WorkQueue *q, char *path) {
-    DirNode *n = (DirNode *)calloc(1, sizeof(DirNode));
-    if (!n) return -1;
-    n->path = path;
+static bool node_before(const DirNode *a, const DirNode *b) {
+    if (a->prio != b->prio) return a->prio > b->prio;
+    return a->seq < b->seq;
+}
+
+static void heap_swap(DirNode *h, size_t i, size_t j) {
+    DirNode t = h[i];
+    h[i] = h[j];
+    h[j] = t;
+}
 
+static int wq_push(WorkQueue *q, DirItem item, RootSlot *root, TaskKind kind, DirChunk *chunk, uint64_t prio) {
     pthread_mutex_lock(&q->mu);
-    if (q->tail) q->tail->next = n;
-    else q->head = n;
-    q->tail = n;
-    q->pending++;
+    if (q->pending == q->heap_cap) {
+        size_t new_cap = (q->heap_cap == 0) ? 64 : q->heap_cap * 2;
+        DirNode *h = (DirNode *)du_realloc(q->alloc, q->heap, new_cap * sizeof(DirNode));
+        if (!h) {
+            pthread_mutex_unlock(&q->mu);
+            return -1;
+        }
+        q->heap = h;
+        q->heap_cap = new_cap;
+    }
+
+    size_t i = q->pending++;
+    q->heap[i] = (DirNode){.item = item, .root = root, .kind = kind, .chunk = chunk, .prio = prio, .seq = q->seq++};
+    while (i > 0 && node_before(&q->heap[i], &q->heap[(i - 1) / 2])) {
+        heap_swap(q->heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    if (q->pending > q->peak) q->peak = q->pending;
+    if (kind == TASK_CHUNK) q->nchunks++;
+    atomic_store_explicit(&q->depth, q->pending, memory_order_relaxed);
+    progress_queued(q->scan, q->pending);
+    root->outstanding++;
     pthread_cond_signal(&q->cv);
     pthread_mutex_unlock(&q->mu);
     return 0;
 }
 
-static char *wq_pop_blocking(WorkQueue *q) {
+/*
+ * The frontier is at its cap: new subdirectories should be read inline. May lag
+ * by a few pushes. Never while paused, so running tasks finish quickly.
+ */
+static bool wq_full(WorkQueue *q) {
+    return q->cap != 0 && atomic_load_explicit(&q->depth, memory_order_relaxed) >= q->cap &&
+           !atomic_load_explicit(&q->paused, memory_order_relaxed);
+}
+
+/* Removes heap entry i into *out. Called with mu held. */
+static void heap_remove(WorkQueue *q, size_t i, DirNode *out) {
+    DirNode *h = q->heap;
+    *out = h[i];
+    h[i] = h[--q->pending];
+    while (i > 0 && i < q->pending && node_before(&h[i], &h[(i - 1) / 2])) {
+        heap_swap(h, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        size_t best = i;
+        size_t l = 2 * i + 1;
+        if (l < q->pending && node_before(&h[l], &h[best])) best = l;
+        if (l + 1 < q->pending && node_before(&h[l + 1], &h[best])) best = l + 1;
+        if (best == i) break;
+        heap_swap(h, i, best);
+        i = best;
+    }
+}
+
+/*
+ * Takes the most important task into *out; while paused, only chunks of split
+ * directories are handed out. Returns false when the pool should exit.
+ */
+static bool wq_pop_blocking(WorkQueue *q, DirNode *out) {
     pthread_mutex_lock(&q->mu);
-    while (!q->done && q->pending == 0) pthread_cond_wait(&q->cv, &q->mu);
+    for (;;) {
+        if (q->status) break;
+        if (atomic_load_explicit(&q->paused, memory_order_relaxed) ? q->nchunks > 0 : q->pending > 0) break;
+        if (q->shutdown && q->pending == 0) break;
+        pthread_cond_wait(&q->cv, &q->mu);
+    }
 
-    if (q->done) {
+    if (q->status || q->pending == 0) {
         pthread_mutex_unlock(&q->mu);
-        return NULL;
+        return false;
     }
 
-    DirNode *n = q->head;
-    q->head = n->next;
-    if (!q->head) q->tail = NULL;
-    q->pending--;
+    size_t i = 0;
+    if (atomic_load_explicit(&q->paused, memory_order_relaxed)) {
+        while (q->heap[i].kind != TASK_CHUNK) i++;
+    }
+    heap_remove(q, i, out);
+    if (out->kind == TASK_CHUNK) q->nchunks--;
     q->active++;
+    atomic_store_explicit(&q->depth, q->pending, memory_order_relaxed);
+    progress_queued(q->scan, q->pending);
     pthread_mutex_unlock(&q->mu);
-
-    char *p = n->path;
-    free(n);
-    return p;
+    return true;
 }
 
-static void wq_worker_done(WorkQueue *q) {
+/*
+ * Stops handing out directories and waits until no task is running or queued
+ * chunk is left, so the queue holds every pending directory and the roots'
+ * totals and hardlink sets match it. Returns with mu held; false after a fatal
+ * error.
+ */
+static bool wq_pause(WorkQueue *q) {
     pthread_mutex_lock(&q->mu);
-    q->active--;
-    if (q->pending == 0 && q->active == 0) {
-        q->done = 1;
-        pthread_cond_broadcast(&q->cv);
-    }
+    atomic_store_explicit(&q->paused, 1, memory_order_relaxed);
+    pthread_cond_broadcast(&q->cv);
+    while (!q->status && (q->active > 0 || q->nchunks > 0)) pthread_cond_wait(&q->idle_cv, &q->mu);
+    return !q->status;
+}
+
+static void wq_unpause(WorkQueue *q) {
+    atomic_store_explicit(&q->paused, 0, memory_order_relaxed);
+    pthread_cond_broadcast(&q->cv);
     pthread_mutex_unlock(&q->mu);
 }
 
 typedef struct SharedState {
-    const DuOptions *opt;
+    const DuScan *scan;
     WorkQueue *q;
-
-    InodeSet *seen;
-    pthread_mutex_t seen_mu;
-
-    uint64_t total_bytes;
-    pthread_mutex_t total_mu;
+    int nworkers;
+    RootSlot *slots;
+    size_t nslots;
+    bool ordered;
+
+    pthread_mutex_t res_mu;
+    pthread_cond_t res_cv; /* caller: a root completed or a fatal error */
+    RootSlot *done_head;   /* completed, undelivered roots (unordered mode) */
+    RootSlot *done_tail;
 } SharedState;
 
 typedef struct WorkerArg {
     SharedState *shared;
     int idx;
+    ScanLocal local;
+    GroupMap **slot_groups; /* per root slot, merged by the caller when the root completes */
 } WorkerArg;
 
-static int handle_regular_parallel(SharedState *s, const struct stat *st) {
+static void wq_stop_all(SharedState *s, int status) {
+    pthread_mutex_lock(&s->q->mu);
+    if (s->q->status == 0) s->q->status = status;
+    pthread_cond_broadcast(&s->q->cv);
+    pthread_cond_broadcast(&s->q->idle_cv);
+    pthread_mutex_unlock(&s->q->mu);
+
+    pthread_mutex_lock(&s->res_mu);
+    pthread_cond_broadcast(&s->res_cv);
+    pthread_mutex_unlock(&s->res_mu);
+}
+
+/* Marks root r complete for the caller. Called with res_mu held. */
+static void root_complete_locked(SharedState *s, RootSlot *r) {
+    r->complete = 1;
+    if (!s->ordered) {
+        r->next_done = NULL;
+        if (s->done_tail) s->done_tail->next_done = r;
+        else s->done_head = r;
+        s->done_tail = r;
+    }
+    pthread_cond_signal(&s->res_cv);
+}
+
+/* Marks one task of root r finished; the last one completes the root. */
+static void wq_task_done(SharedState *s, RootSlot *r) {
+    WorkQueue *q = s->q;
+    pthread_mutex_lock(&q->mu);
+    int last = (--r->outstanding == 0);
+    if (--q->active == 0 && atomic_load_explicit(&q->paused, memory_order_relaxed) && q->nchunks == 0)
+        pthread_cond_signal(&q->idle_cv);
+    pthread_mutex_unlock(&q->mu);
+    if (!last) return;
+
+    pthread_mutex_lock(&s->res_mu);
+    root_complete_locked(s, r);
+    pthread_mutex_unlock(&s->res_mu);
+}
+
+/* Returns 0, 1 on OOM or 3 if the visitor aborted. */
+static int handle_regular_parallel(SharedState *s, RootSlot *r, const char *path, const char *name,
+                                   const struct stat *st, uint64_t dir_id, ScanLocal *local) {
     InodeKey k = {.dev = st->st_dev, .ino = st->st_ino};
     bool oom = false;
 
-    pthread_mutex_lock(&s->seen_mu);
-    bool inserted = inode_set_insert(s->seen, k, &oom);
-    pthread_mutex_unlock(&s->seen_mu);
+    pthread_mutex_lock(&r->mu);
+    bool inserted = inode_set_insert(r->seen, k, &oom);
+    if (inserted) r->total_bytes += (uint64_t)st->st_size;
+    pthread_mutex_unlock(&r->mu);
 
-    if (oom) return -1;
-    if (!inserted) return 0;
+    if (oom) return 1;
+    progress_file(local, inserted, st);
+    if (inserted && group_add(local->groups, &s->scan->opt, r->now, name, st) != 0) return 1;
+    if (manifest_note(s->scan, local, MANIFEST_FILE, inserted, dir_id, 0, name, st) != 0) return 1;
+    return visit_entry(s->scan, local, path, st, inserted);
+}
+
+/*
+ * Inline descent (frontier full) keeps one open directory per level, so it is
+ * limited in depth; deeper subdirectories are queued regardless of the cap.
+ */
+#define INLINE_MAX_DEPTH 64
+
+static int process_dir_parallel(SharedState *s, RootSlot *r, const DirItem *item, ScanLocal *local, int depth);
+
+static uint64_t history_find(const DuScan *scan, uint64_t parent_hist, const char *name) {
+    if (!scan->history || !parent_hist) return 0;
+    return manifest_sizes_find(scan->history, parent_hist, name, strlen(name));
+}
+
+/*
+ * Estimated work below a directory, so that large subtrees start (and split)
+ * first instead of being found late and read by one worker while the others
+ * idle. The scan history gives the previous recursive entry count; otherwise
+ * the directory's own size (which grows with its entry count on common
+ * filesystems) times its subdirectory count (st_nlink - 2) stands in for it.
+ */
+static uint64_t subtree_estimate(const DuScan *scan, const DirItem *sub, const struct stat *st) {
+    if (scan->opt.schedule != DU_SCHEDULE_LARGEST_FIRST) return 0;
+
+    uint64_t prev = sub->hist ? manifest_sizes_entries(scan->history, sub->hist) : 0;
+    if (prev) return prev;
+
+    uint64_t width = (st->st_size > 0) ? (uint64_t)st->st_size / 32 + 1 : 1;
+    uint64_t subdirs = (st->st_nlink > 2) ? (uint64_t)st->st_nlink - 2 : 0;
+    return width * (subdirs + 1);
+}
 
-    pthread_mutex_lock(&s->total_mu);
-    s->total_bytes += (uint64_t)st->st_size;
-    pthread_mutex_unlock(&s->total_mu);
+/*
+ * Stats one entry of a directory relative to its fd, then counts or reports it.
+ * A subdirectory is queued for any worker or, while the queue is at its cap,
+ * read depth-first right away, so the frontier stays bounded by the cap plus
+ * depth times workers. Returns 0, or a fatal status (1 OOM, 3 aborted).
+ */
+static int process_entry_parallel(SharedState *s, RootSlot *r, const DirItem *parent, int dfd, const char *name,
+                                  ScanLocal *local, int depth) {
+    const DuAllocator *a = &s->scan->alloc;
+    uint64_t dir_id = parent->id;
+
+    char *child = path_join_with(a, parent->path, name);
+    if (!child) return 1;
+
+    struct stat csb;
+    if (throttled_stat(s->scan, dfd, name, &csb) != 0) {
+        warn_errno(s->scan, "cannot stat", child);
+        du_free(a, child);
+        return 0;
+    }
+
+    int rc = 0;
+    if (S_ISDIR(csb.st_mode) ? !shard_owns_dir(&s->scan->opt, child, parent->level + 1)
+                             : !shard_owns_entries(&s->scan->opt, parent->level)) {
+        du_free(a, child);
+        return 0;
+    }
+
+    if (S_ISDIR(csb.st_mode)) {
+        DirItem sub = {.path = child, .id = manifest_dir_id(s->scan), .level = parent->level + 1};
+        sub.hist = history_find(s->scan, parent->hist, name);
+        rc = visit_entry(s->scan, local, child, &csb, false);
+        if (rc == 0) rc = manifest_note(s->scan, local, MANIFEST_DIR, false, sub.id, dir_id, name, &csb);
+        if (rc == 0 && depth < INLINE_MAX_DEPTH && wq_full(s->q)) {
+            rc = process_dir_parallel(s, r, &sub, local, depth + 1);
+        } else if (rc == 0) {
+            uint64_t prio = subtree_estimate(s->scan, &sub, &csb);
+            if (wq_push(s->q, sub, r, TASK_DIR, NULL, prio) == 0) return 0; /* the queue owns child */
+            rc = 1;
+        }
+        du_free(a, child);
+        return rc;
+    }
+
+    if (S_ISREG(csb.st_mode)) rc = handle_regular_parallel(s, r, child, name, &csb, dir_id, local);
+    else rc = visit_entry(s->scan, local, child, &csb, false);
+    du_free(a, child);
+    return rc;
+}
+
+static int process_chunk(SharedState *s, RootSlot *r, const DirChunk *c, const DirShare *sh, ScanLocal *local) {
+    const DirItem parent = {.path = sh->path, .id = sh->id, .hist = sh->hist, .level = sh->level};
+    const char *name = c->names;
+    for (size_t i = 0; i < c->count; i++) {
+        int rc = process_entry_parallel(s, r, &parent, sh->fd, name, local, 0);
+        if (rc != 0) return rc;
+        name += strlen(name) + 1;
+    }
+    return 0;
+}
+
+/*
+ * Hands a full chunk to the pool, or processes it on the owner's thread when
+ * enough chunks of this directory are in flight or the queue is at its cap.
+ */
+static int chunk_dispatch(SharedState *s, RootSlot *r, DirShare *sh, DirChunk **chunk, ScanLocal *local) {
+    const DuAllocator *a = &s->scan->alloc;
+    DirChunk *c = *chunk;
+    *chunk = NULL;
+
+    if (atomic_load_explicit(&sh->inflight, memory_order_relaxed) < 2 * s->nworkers && !wq_full(s->q)) {
+        c->dir = sh;
+        atomic_fetch_add(&sh->refs, 1);
+        atomic_fetch_add(&sh->inflight, 1);
+        DirItem none = {.path = NULL, .id = sh->id, .hist = 0};
+        if (wq_push(s->q, none, r, TASK_CHUNK, c, UINT64_MAX) == 0) return 0;
+        atomic_fetch_sub(&sh->inflight, 1);
+        atomic_fetch_sub(&sh->refs, 1); /* the owner still holds a reference */
+        du_free(a, c);
+        return 1;
+    }
+
+    int rc = process_chunk(s, r, c, sh, local);
+    du_free(a, c);
+    return rc;
+}
+
+static int chunk_add(SharedState *s, RootSlot *r, DirShare *sh, DirChunk **chunk, const char *name,
+                     ScanLocal *local) {
+    size_t len = strlen(name) + 1;
+    if (*chunk && ((*chunk)->count == CHUNK_NAMES || (*chunk)->used + len > CHUNK_BYTES)) {
+        int rc = chunk_dispatch(s, r, sh, chunk, local);
+        if (rc != 0) return rc;
+    }
+    if (!*chunk) {
+        *chunk = (DirChunk *)du_malloc(&s->scan->alloc, sizeof(DirChunk) + CHUNK_BYTES);
+        if (!*chunk) return 1;
+        (*chunk)->dir = NULL;
+        (*chunk)->count = 0;
+        (*chunk)->used = 0;
+    }
+    memcpy((*chunk)->names + (*chunk)->used, name, len);
+    (*chunk)->used += len;
+    (*chunk)->count++;
     return 0;
 }
 
-static int process_dir_parallel(SharedState *s, const char *dirpath) {
-    DIR *dir = opendir(dirpath);
+/*
+ * Reads one directory. Past opt.split_entries entries the directory is split:
+ * the rest of its names are handed out in chunks, so one huge flat directory
+ * is stat'ed by all workers. Returns 0, or a fatal status (1 OOM, 3 aborted)
+ * that stops all workers.
+ */
+static int process_dir_parallel(SharedState *s, RootSlot *r, const DirItem *item, ScanLocal *local, int depth) {
+    const DuAllocator *a = &s->scan->alloc;
+    const char *dirpath = item->path;
+    size_t split_at = (s->nworkers > 1) ? s->scan->opt.split_entries : 0;
+    progress_dir(local);
+
+    DIR *dir = scan_opendir(s->scan, dirpath);
     if (!dir) {
-        warn_errno(s->opt, "cannot open directory", dirpath);
+        warn_errno(s->scan, "cannot open directory", dirpath);
         return 0;
     }
+    int dfd = dirfd(dir);
 
+    size_t nentries = 0;
+    DirShare *share = NULL;
+    DirChunk *chunk = NULL;
+
+    int rc = 0;
     errno = 0;
     for (struct dirent *de = readdir(dir); de; de = readdir(dir)) {
         const char *name = de->d_name;
         if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
 
-        char *child = path_join(dirpath, name);
-        if (!child) {
-            closedir(dir);
-            return 1; /* fatal OOM */
-        }
-
-        struct stat csb;
-        if (lstat(child, &csb) != 0) {
-            warn_errno(s->opt, "cannot stat", child);
-            free(child);
-            continue;
-        }
-
-        if (S_ISDIR(csb.st_mode)) {
-            if (wq_push(s->q, child) != 0) {
-                free(child);
-                closedir(dir);
-                return 1; /* fatal OOM */
+        if (!share && split_at != 0 && ++nentries > split_at) {
+            share = dir_share_open(a, dfd, item);
+            if (!share) {
+                rc = 1;
+                break;
             }
-            continue;
+            dbg_threads(s->scan, "split-dir path=%s", dirpath);
         }
 
-        if (S_ISREG(csb.st_mode)) {
-            int rc = handle_regular_parallel(s, &csb);
-            free(child);
-            if (rc != 0) {
-                closedir(dir);
-                return 1; /* fatal OOM */
-            }
-            continue;
-        }
-
-        free(child);
+        if (share) rc = chunk_add(s, r, share, &chunk, name, local);
+        else rc = process_entry_parallel(s, r, item, dfd, name, local, depth);
+        if (rc != 0) break;
+        errno = 0;
     }
 
-    if (errno != 0) warn_errno(s->opt, "error reading directory", dirpath);
+    if (rc == 0 && errno != 0) warn_errno(s->scan, "error reading directory", dirpath);
+    if (rc == 0 && chunk) rc = chunk_dispatch(s, r, share, &chunk, local);
 
+    du_free(a, chunk);
+    dir_share_release(a, share);
     closedir(dir);
-    return 0;
+    return rc;
 }
 
-static void wq_stop_all(WorkQueue *q) {
-    pthread_mutex_lock(&q->mu);
-    q->done = 1;
-    pthread_cond_broadcast(&q->cv);
-    pthread_mutex_unlock(&q->mu);
+/* First task of a root: stat it, then count it (file) or read it (directory). */
+static int process_root_parallel(SharedState *s, RootSlot *r, DirItem *item, ScanLocal *local) {
+    const DuScan *scan = s->scan;
+    const char *root_path = item->path;
+
+    struct stat sb;
+    if (scan_lstat(scan, root_path, &sb) != 0) {
+        warn_errno(scan, "cannot stat", root_path);
+        return 0;
+    }
+
+    if (!S_ISDIR(sb.st_mode) && !shard_owns_entries(&scan->opt, 0)) return 0;
+    if (S_ISREG(sb.st_mode)) return handle_regular_parallel(s, r, root_path, base_name(root_path), &sb, 0, local);
+
+    int rc = visit_entry(scan, local, root_path, &sb, false);
+    if (rc != 0 || !S_ISDIR(sb.st_mode)) return rc;
+
+    item->id = manifest_dir_id(scan);
+    if (scan->history) item->hist = manifest_sizes_find(scan->history, 0, root_path, strlen(root_path));
+    rc = manifest_note(scan, local, MANIFEST_DIR, false, item->id, 0, root_path, &sb);
+    if (rc != 0) return rc;
+    return process_dir_parallel(s, r, item, local, 0);
 }
 
 static void *worker_main(void *arg) {
     WorkerArg *wa = (WorkerArg *)arg;
     SharedState *s = wa->shared;
+    const DuAllocator *a = &s->scan->alloc;
     int idx = wa->idx;
 
-    dbg_threads(s->opt, "worker-start idx=%d", idx);
+    dbg_threads(s->scan, "worker-start idx=%d", idx);
 
     for (;;) {
-        char *dirpath = wq_pop_blocking(s->q);
-        if (!dirpath) break;
-
-        dbg_threads(s->opt, "pop-dir idx=%d path=%s", idx, dirpath);
-
-        int fatal = process_dir_parallel(s, dirpath);
-        free(dirpath);
+        DirNode node;
+        if (!wq_pop_blocking(s->q, &node)) break;
+        DirNode *task = &node;
+
+        RootSlot *r = task->root;
+        if (task->kind == TASK_CHUNK) dbg_threads(s->scan, "pop-chunk idx=%d path=%s", idx, task->chunk->dir->path);
+        else dbg_threads(s->scan, "pop-dir idx=%d path=%s", idx, task->item.path);
+
+        int fatal = 0;
+        wa->local.root = r->index;
+        if (wa->slot_groups) {
+            size_t slot = (size_t)(r - s->slots);
+            if (!wa->slot_groups[slot]) wa->slot_groups[slot] = group_map_create_with(a);
+            wa->local.groups = wa->slot_groups[slot];
+            if (!wa->local.groups) fatal = 1;
+        }
 
-        wq_worker_done(s->q);
+        if (!fatal && task->kind == TASK_ROOT) {
+            fatal = process_root_parallel(s, r, &task->item, &wa->local);
+        } else if (!fatal && task->kind == TASK_CHUNK) {
+            fatal = process_chunk(s, r, task->chunk, task->chunk->dir, &wa->local);
+        } else if (!fatal) {
+            fatal = process_dir_parallel(s, r, &task->item, &wa->local, 0);
+        }
+        if (task->chunk) {
+            atomic_fetch_sub(&task->chunk->dir->inflight, 1);
+            dir_share_release(a, task->chunk->dir);
+            du_free(a, task->chunk);
+        }
+        du_free(a, task->item.path);
 
         if (fatal) {
-            dbg_threads(s->opt, "fatal-oom idx=%d stopping", idx);
-            wq_stop_all(s->q);
+            dbg_threads(s->scan, "fatal status=%d idx=%d stopping", fatal, idx);
+            wq_stop_all(s, fatal);
             break;
         }
+        wq_task_done(s, r);
     }
 
-    dbg_threads(s->opt, "worker-exit idx=%d", idx);
+    scan_local_flush(s->scan, &wa->local);
+    dbg_threads(s->scan, "worker-exit idx=%d", idx);
     return NULL;
 }
 
-static int du_sync_sum_regular_bytes_parallel(const char *root_path, const DuOptions *opt,
-                                              uint64_t *out_bytes) {
-    *out_bytes = 0;
+/* Readies slot r for root `index`. Returns 0, or 1 on OOM. */
+static int slot_admit(const DuScan *scan, RootSlot *r, size_t index, const char *path) {
+    r->index = index;
+    r->path = path;
+    r->now = time(NULL);
+    r->total_bytes = 0;
+    r->outstanding = 0;
+    r->complete = 0;
+    r->next_done = NULL;
+    r->seen = inode_set_create_with(&scan->alloc);
+    return r->seen ? 0 : 1;
+}
 
-    InodeSet *seen = inode_set_create();
-    if (!seen) return 1;
+/* Delivers a completed root; called on the caller's thread without res_mu held. */
+static int slot_deliver(SharedState *s, WorkerArg *args, int nworkers, RootSlot *r, int status, DuResultFn on_result,
+                        void *user) {
+    size_t slot = (size_t)(r - s->slots);
+    for (int i = 0; i < nworkers && r->groups; i++) {
+        GroupMap *wg = args[i].slot_groups[slot];
+        if (!wg) continue;
+        if (status == 0 && group_map_merge(r->groups, wg) != 0) status = 1;
+        group_map_clear(wg);
+    }
+
+    DuRootResult res = {
+        .index = r->index,
+        .path = r->path,
+        .status = status,
+        .bytes = r->total_bytes,
+        .groups = r->groups,
+    };
+    if (on_result) on_result(user, &res);
+
+    group_map_clear(r->groups);
+    inode_set_destroy(r->seen);
+    r->seen = NULL;
+    return status;
+}
+
+static int slot_index_cmp(const void *pa, const void *pb) {
+    const RootSlot *a = *(const RootSlot *const *)pa;
+    const RootSlot *b = *(const RootSlot *const *)pb;
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+/*
+ * Saves the run while the pool is paused (q->mu held): roots in flight are
+ * written from their slots, each with its queued tasks.
+ */
+static void ckpt_save_parallel(CkptRun *ck, SharedState *s) {
+    const DuAllocator *a = &s->scan->alloc;
+    const WorkQueue *q = s->q;
+    RootSlot **live = (RootSlot **)du_calloc(a, s->nslots, sizeof(RootSlot *));
+    size_t *end = (size_t *)du_calloc(a, s->nslots + 1, sizeof(size_t));
+    size_t *order = (size_t *)du_calloc(a, q->pending + 1, sizeof(size_t));
+    if (!live || !end || !order) {
+        errno = ENOMEM;
+        warn_errno(s->scan, "cannot write checkpoint", s->scan->ckpt_path);
+        goto out;
+    }
+
+    size_t nlive = 0;
+    for (size_t k = 0; k < s->nslots; k++) {
+        if (s->slots[k].seen) live[nlive++] = &s->slots[k];
+    }
+    qsort(live, nlive, sizeof(RootSlot *), slot_index_cmp);
+
+    /* Counting sort of the queued tasks by slot: slot k owns order[end[k - 1] .. end[k]). */
+    for (size_t i = 0; i < q->pending; i++) end[(size_t)(q->heap[i].root - s->slots) + 1]++;
+    for (size_t k = 0; k < s->nslots; k++) end[k + 1] += end[k];
+    for (size_t i = 0; i < q->pending; i++) order[end[(size_t)(q->heap[i].root - s->slots)]++] = i;
+
+    CheckpointWriter *w = ckpt_begin(ck);
+    if (!w) goto out;
+
+    size_t li = 0;
+    for (size_t i = 0; i < ck->n; i++) {
+        RootSlot *r = (li < nlive && live[li]->index == i) ? live[li++] : NULL;
+        if (!r) {
+            ckpt_put_idle_root(ck, w, i);
+            continue;
+        }
+        if (r->outstanding == 0) {
+            checkpoint_write_root(w, CHECKPOINT_DONE, 0, r->total_bytes, r->path);
+            continue;
+        }
+
+        size_t k = (size_t)(r - s->slots);
+        size_t lo = (k == 0) ? 0 : end[k - 1];
+        checkpoint_write_root(w, CHECKPOINT_RUNNING, 0, r->total_bytes, r->path);
+        checkpoint_write_inodes(w, r->seen);
+        checkpoint_write_task_count(w, end[k] - lo);
+        for (size_t j = lo; j < end[k]; j++) {
+            const DirNode *t = &q->heap[order[j]];
+            uint8_t kind = (t->kind == TASK_ROOT) ? CHECKPOINT_TASK_ROOT : CHECKPOINT_TASK_DIR;
+            checkpoint_write_task(w, kind, t->prio, t->item.path);
+        }
+    }
+    ckpt_end(ck, w);
+
+out:
+    du_free(a, order);
+    du_free(a, end);
+    du_free(a, live);
+}
+
+/*
+ * Admits root r as saved in the resumed checkpoint: a finished root completes
+ * at once, a running one gets its hardlink set, total and pending tasks back.
+ * Called with res_mu held. Returns 0, or 1 on OOM.
+ */
+static int slot_resume(SharedState *s, CkptRun *ck, RootSlot *r, const CheckpointRoot *saved) {
+    const DuAllocator *a = &s->scan->alloc;
+    r->total_bytes = saved->bytes;
+    if (saved->state == CHECKPOINT_DONE) {
+        root_complete_locked(s, r);
+        return 0;
+    }
+    if (checkpoint_load_inodes(ck->resume, r->index, r->seen) != 0) return 1;
+
+    /* An extra reference until every task is queued, so that the root cannot complete early. */
+    pthread_mutex_lock(&s->q->mu);
+    r->outstanding++;
+    pthread_mutex_unlock(&s->q->mu);
+
+    int rc = 0;
+    size_t pos = 0;
+    CheckpointTask t;
+    while (rc == 0 && checkpoint_next_task(ck->resume, r->index, &pos, &t)) {
+        DirItem item = {.path = ckpt_task_path(a, &t), .id = 0, .hist = 0};
+        TaskKind kind = (t.kind == CHECKPOINT_TASK_ROOT) ? TASK_ROOT : TASK_DIR;
+        if (!item.path || wq_push(s->q, item, r, kind, NULL, t.prio) != 0) {
+            du_free(a, item.path);
+            rc = 1;
+        }
+    }
+
+    pthread_mutex_lock(&s->q->mu);
+    int last = (--r->outstanding == 0);
+    pthread_mutex_unlock(&s->q->mu);
+    if (last) root_complete_locked(s, r);
+    return rc;
+}
+
+static int du_sync_run_many_parallel(const DuScan *scan, const char *const *roots, size_t n, size_t window,
+                                     bool ordered, DuResultFn on_result, void *user, CkptRun *ck, size_t *peak) {
+    const DuAllocator *a = &scan->alloc;
+    int jobs = (scan->opt.jobs > 1) ? scan->opt.jobs : 1;
+    bool grouping = scan->opt.group_by != DU_GROUP_NONE;
+    size_t nslots = (window == 0) ? 1 : (window < n ? window : n);
 
     WorkQueue q;
-    wq_init(&q);
+    wq_init(&q, scan);
 
     SharedState s = {
-        .opt = opt,
+        .scan = scan,
         .q = &q,
-        .seen = seen,
-        .total_bytes = 0,
+        .slots = NULL,
+        .nslots = nslots,
+        .nworkers = jobs,
+        .ordered = ordered,
+        .done_head = NULL,
+        .done_tail = NULL,
     };
-    pthread_mutex_init(&s.seen_mu, NULL);
-    pthread_mutex_init(&s.total_mu, NULL);
+    pthread_condattr_t res_attr;
+    pthread_condattr_init(&res_attr);
+    pthread_condattr_setclock(&res_attr, CLOCK_MONOTONIC); /* checkpoint deadlines come from now_seconds */
+    pthread_mutex_init(&s.res_mu, NULL);
+    pthread_cond_init(&s.res_cv, &res_attr);
+    pthread_condattr_destroy(&res_attr);
+
+    int rc = 0;
+    int nthreads = 0;
+    pthread_t *threads = (pthread_t *)du_calloc(a, (size_t)jobs, sizeof(pthread_t));
+    WorkerArg *args = (WorkerArg *)du_calloc(a, (size_t)jobs, sizeof(WorkerArg));
+    RootSlot *slots = (RootSlot *)du_calloc(a, nslots, sizeof(RootSlot));
+    RootSlot **free_slots = (RootSlot **)du_calloc(a, nslots, sizeof(RootSlot *));
+    size_t nfree = 0;
+    s.slots = slots;
+    if (!threads || !args || !slots || !free_slots) {
+        rc = 1;
+        goto out;
+    }
 
-    struct stat sb;
-    if (lstat(root_path, &sb) != 0) {
-        warn_errno(opt, "cannot stat", root_path);
-        wq_destroy(&q);
-        pthread_mutex_destroy(&s.seen_mu);
-        pthread_mutex_destroy(&s.total_mu);
-        inode_set_destroy(seen);
+    for (size_t i = 0; i < nslots; i++) {
+        pthread_mutex_init(&slots[i].mu, NULL);
+        free_slots[nfree++] = &slots[nslots - 1 - i];
+        if (grouping && !(slots[i].groups = group_map_create_with(a))) rc = 1;
+    }
+    for (int i = 0; i < jobs && grouping && rc == 0; i++) {
+        args[i].slot_groups = (GroupMap **)du_calloc(a, nslots, sizeof(GroupMap *));
+        if (!args[i].slot_groups) rc = 1;
+    }
+    if (rc != 0) goto out;
+
+    for (; nthreads < jobs; nthreads++) {
+        args[nthreads].shared = &s;
+        args[nthreads].idx = nthreads;
+        args[nthreads].local.ctr = counter_slot(scan, (size_t)nthreads + 1);
+        if (pthread_create(&threads[nthreads], NULL, worker_main, &args[nthreads]) != 0) {
+            dbg_threads(scan, "pthread_create failed at idx=%d", nthreads);
+            break;
+        }
+    }
+    if (nthreads == 0) {
+        rc = 1;
+        goto out;
+    }
+
+    size_t next_admit = 0; /* next root to start */
+    size_t next_emit = 0;  /* ordered: next root to deliver */
+    size_t delivered = 0;
+
+    pthread_mutex_lock(&s.res_mu);
+    while (delivered < n) {
+        while (next_admit < n && rc == 0) {
+            RootSlot *r = NULL;
+            if (ordered && next_admit < next_emit + nslots) r = &slots[next_admit % nslots];
+            else if (!ordered && nfree > 0) r = free_slots[--nfree];
+            if (!r) break;
+
+            CheckpointRoot saved;
+            ckpt_state(ck, next_admit, &saved);
+            int st = slot_admit(scan, r, next_admit, roots[next_admit]);
+            if (st == 0 && saved.state != CHECKPOINT_PENDING) {
+                st = slot_resume(&s, ck, r, &saved);
+            } else if (st == 0) {
+                char *root_copy = xstrdup_with(a, roots[next_admit]);
+                DirItem item = {.path = root_copy, .id = 0, .hist = 0};
+                if (!root_copy || wq_push(&q, item, r, TASK_ROOT, NULL, UINT64_MAX) != 0) {
+                    du_free(a, root_copy);
+                    st = 1;
+                }
+            }
+            if (st != 0) {
+                rc = 1;
+                break;
+            }
+            next_admit++;
+        }
+
+        size_t round = 0;
+        for (;;) {
+            RootSlot *r = NULL;
+            if (ordered && next_emit < next_admit && slots[next_emit % nslots].complete) {
+                r = &slots[next_emit % nslots];
+                next_emit++;
+            } else if (!ordered && s.done_head) {
+                r = s.done_head;
+                s.done_head = r->next_done;
+                if (!s.done_head) s.done_tail = NULL;
+            }
+            if (!r) break;
+
+            pthread_mutex_unlock(&s.res_mu);
+            int st = slot_deliver(&s, args, jobs, r, 0, on_result, user);
+            ckpt_delivered(ck, r->index, st, r->total_bytes);
+            pthread_mutex_lock(&s.res_mu);
+
+            if (st != 0 && rc == 0) rc = st;
+            if (!ordered) free_slots[nfree++] = r;
+            delivered++;
+            round++;
+        }
+
+        if (delivered == n || rc != 0) break;
+        if (round > 0) continue; /* slots were freed: admit more roots first */
+        pthread_mutex_lock(&q.mu);
+        int qstatus = q.status;
+        pthread_mutex_unlock(&q.mu);
+        if (qstatus != 0) {
+            rc = qstatus;
+            break;
+        }
+        if (!ck->results) {
+            pthread_cond_wait(&s.res_cv, &s.res_mu);
+            continue;
+        }
+
+        struct timespec until = {.tv_sec = (time_t)ck->next};
+        until.tv_nsec = (long)((ck->next - (double)until.tv_sec) * 1e9);
+        pthread_cond_timedwait(&s.res_cv, &s.res_mu, &until);
+        if (ckpt_due(ck)) {
+            pthread_mutex_unlock(&s.res_mu);
+            if (wq_pause(&q)) ckpt_save_parallel(ck, &s);
+            wq_unpause(&q);
+            pthread_mutex_lock(&s.res_mu);
+        }
+    }
+    pthread_mutex_unlock(&s.res_mu);
+
+    if (rc != 0) wq_stop_all(&s, rc);
+
+    pthread_mutex_lock(&q.mu);
+    q.shutdown = 1;
+    pthread_cond_broadcast(&q.cv);
+    pthread_mutex_unlock(&q.mu);
+
+    for (int i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+
+    /* After a fatal error, every root not yet delivered is reported with that status. */
+    if (rc != 0) {
+        for (size_t i = 0; i < n && on_result; i++) {
+            bool was_delivered = false;
+            if (ordered) was_delivered = i < next_emit;
+            if (!ordered) {
+                was_delivered = i < next_admit;
+                for (size_t k = 0; k < nslots && was_delivered; k++) {
+                    if (slots[k].seen && slots[k].index == i) was_delivered = false;
+                }
+            }
+            if (was_delivered) continue;
+            DuRootResult res = {.index = i, .path = roots[i], .status = rc, .bytes = 0, .groups = NULL};
+            on_result(user, &res);
+        }
+    }
+
+out:
+    for (int i = 0; i < jobs && args; i++) {
+        for (size_t k = 0; k < nslots && args[i].slot_groups; k++) group_map_destroy(args[i].slot_groups[k]);
+        du_free(a, args[i].slot_groups);
+    }
+    for (size_t i = 0; i < nslots && slots; i++) {
+        inode_set_destroy(slots[i].seen);
+        group_map_destroy(slots[i].groups);
+        pthread_mutex_destroy(&slots[i].mu);
+    }
+    du_free(a, free_slots);
+    du_free(a, slots);
+    du_free(a, args);
+    du_free(a, threads);
+
+    dbg_threads(scan, "frontier-peak=%zu cap=%zu", q.peak, q.cap);
+    if (q.peak > *peak) *peak = q.peak;
+    wq_destroy(&q);
+    pthread_cond_destroy(&s.res_cv);
+    pthread_mutex_destroy(&s.res_mu);
+    return rc;
+}
+
+/* ---------------- File lists (one lstat per path, one hardlink set) ---------------- */
+
+#define LIST_BATCH 256
+
+typedef struct ListEntry {
+    struct stat st;
+    int err; /* errno of a failed lstat, 0 on success */
+} ListEntry;
+
+/*
+ * Workers lstat batches of consecutive paths into a ring of nslots batch slots;
+ * the caller consumes the batches in list order, so hardlinks are attributed to
+ * their first listed name exactly like a sequential run.
+ */
+typedef struct ListState {
+    const DuScan *scan;
+    const char *const *paths;
+    size_t n;
+    size_t nbatches;
+    size_t nslots;
+    ListEntry *ents;     /* nslots * LIST_BATCH; batch b uses slot b % nslots */
+    unsigned char *done; /* per slot: lstat results are ready */
+    size_t next_claim;   /* next batch to lstat */
+    size_t next_emit;    /* next batch to deliver */
+    int stop;
+    pthread_mutex_t mu;
+    pthread_cond_t work_cv; /* workers: a slot was freed, or stop */
+    pthread_cond_t done_cv; /* caller: a batch is ready */
+} ListState;
+
+static void list_stat_batch(ListState *ls, size_t b) {
+    size_t first = b * LIST_BATCH;
+    size_t end = (ls->n - first < LIST_BATCH) ? ls->n : first + LIST_BATCH;
+    ListEntry *e = &ls->ents[(b % ls->nslots) * LIST_BATCH];
+
+    for (size_t i = first; i < end; i++, e++) e->err = (scan_lstat(ls->scan, ls->paths[i], &e->st) == 0) ? 0 : errno;
+}
+
+static void *list_worker_main(void *arg) {
+    ListState *ls = (ListState *)arg;
+
+    pthread_mutex_lock(&ls->mu);
+    for (;;) {
+        while (!ls->stop && ls->next_claim < ls->nbatches && ls->next_claim >= ls->next_emit + ls->nslots)
+            pthread_cond_wait(&ls->work_cv, &ls->mu);
+        if (ls->stop || ls->next_claim >= ls->nbatches) break;
+
+        size_t b = ls->next_claim++;
+        pthread_mutex_unlock(&ls->mu);
+        list_stat_batch(ls, b);
+        pthread_mutex_lock(&ls->mu);
+
+        ls->done[b % ls->nslots] = 1;
+        pthread_cond_signal(&ls->done_cv);
+    }
+    pthread_mutex_unlock(&ls->mu);
+    return NULL;
+}
+
+/* Counts one listed path from its lstat result. Returns 0, 1 on OOM or 3 if the visitor aborted. */
+static int list_count_entry(const DuScan *scan, InodeSet *seen, time_t now, const char *path,
+                            const ListEntry *e, uint64_t *bytes, ScanLocal *local, size_t *peak) {
+    if (e->err != 0) {
+        errno = e->err;
+        warn_errno(scan, "cannot stat", path);
         return 0;
     }
 
-    if (S_ISREG(sb.st_mode)) {
-        int rc = handle_regular_parallel(&s, &sb);
-        *out_bytes = s.total_bytes;
-        wq_destroy(&q);
-        pthread_mutex_destroy(&s.seen_mu);
-        pthread_mutex_destroy(&s.total_mu);
-        inode_set_destroy(seen);
-        return (rc == 0) ? 0 : 1;
+    /* A listed directory is traversed here, sharing the list's hardlink set. */
+    if (S_ISDIR(e->st.st_mode)) return scan_tree_sequential(scan, seen, path, bytes, local->groups, peak, NULL);
+    if (!S_ISREG(e->st.st_mode)) return visit_entry(scan, local, path, &e->st, false);
+
+    bool inserted = false;
+    if (inode_add_once(seen, &e->st, bytes, &inserted) != 0) return 1;
+    progress_file(local, inserted, &e->st);
+    if (inserted && group_add(local->groups, &scan->opt, now, base_name(path), &e->st) != 0) return 1;
+    return visit_entry(scan, local, path, &e->st, inserted);
+}
+
+static int du_sync_run_list(const DuScan *scan, const char *const *paths, size_t n, DuResultFn on_result,
+                            void *user, uint64_t *out_total, GroupMap *groups, size_t *peak) {
+    const DuAllocator *a = &scan->alloc;
+    int jobs = (scan->opt.jobs > 1) ? scan->opt.jobs : 0; /* 0: lstat on the calling thread */
+    time_t now = time(NULL);
+    ScanLocal local = {.groups = groups, .mblk = NULL, .ctr = counter_slot(scan, 0)};
+
+    ListState ls = {
+        .scan = scan,
+        .paths = paths,
+        .n = n,
+        .nbatches = (n + LIST_BATCH - 1) / LIST_BATCH,
+        .nslots = jobs ? (size_t)jobs * 4 : 1,
+    };
+    pthread_mutex_init(&ls.mu, NULL);
+    pthread_cond_init(&ls.work_cv, NULL);
+    pthread_cond_init(&ls.done_cv, NULL);
+
+    int rc = 0;
+    int nthreads = 0;
+    size_t delivered = 0;
+    InodeSet *seen = inode_set_create_with(a);
+    pthread_t *threads = jobs ? (pthread_t *)du_calloc(a, (size_t)jobs, sizeof(pthread_t)) : NULL;
+    ls.ents = (ListEntry *)du_calloc(a, ls.nslots * LIST_BATCH, sizeof(ListEntry));
+    ls.done = (unsigned char *)du_calloc(a, ls.nslots, 1);
+    if (!seen || (jobs && !threads) || !ls.ents || !ls.done) {
+        rc = 1;
+        goto out;
     }
 
-    if (!S_ISDIR(sb.st_mode)) {
-        wq_destroy(&q);
-        pthread_mutex_destroy(&s.seen_mu);
-        pthread_mutex_destroy(&s.total_mu);
-        inode_set_destroy(seen);
+    for (; nthreads < jobs; nthreads++) {
+        if (pthread_create(&threads[nthreads], NULL, list_worker_main, &ls) != 0) break;
+    }
+    if (jobs && nthreads == 0) {
+        rc = 1;
+        goto out;
+    }
+
+    for (size_t b = 0; b < ls.nbatches && rc == 0; b++) {
+        size_t slot = b % ls.nslots;
+        if (!jobs) {
+            list_stat_batch(&ls, b);
+        } else {
+            pthread_mutex_lock(&ls.mu);
+            while (!ls.done[slot]) pthread_cond_wait(&ls.done_cv, &ls.mu);
+            pthread_mutex_unlock(&ls.mu);
+        }
+
+        const ListEntry *e = &ls.ents[slot * LIST_BATCH];
+        for (size_t i = b * LIST_BATCH; i < n && i < (b + 1) * LIST_BATCH; i++, e++) {
+            uint64_t bytes = 0;
+            rc = list_count_entry(scan, seen, now, paths[i], e, &bytes, &local, peak);
+            if (rc != 0) break;
+
+            *out_total += bytes;
+            DuRootResult res = {.index = i, .path = paths[i], .status = 0, .bytes = bytes, .groups = NULL};
+            if (on_result) on_result(user, &res);
+            delivered = i + 1;
+        }
+
+        pthread_mutex_lock(&ls.mu);
+        ls.done[slot] = 0;
+        ls.next_emit++;
+        pthread_cond_broadcast(&ls.work_cv);
+        pthread_mutex_unlock(&ls.mu);
+    }
+
+out:
+    pthread_mutex_lock(&ls.mu);
+    ls.stop = 1;
+    pthread_cond_broadcast(&ls.work_cv);
+    pthread_mutex_unlock(&ls.mu);
+    for (int i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+
+    /* After a fatal error, the entries not yet delivered are reported with that status. */
+    for (size_t i = delivered; i < n && rc != 0 && on_result; i++) {
+        DuRootResult res = {.index = i, .path = paths[i], .status = rc, .bytes = 0, .groups = NULL};
+        on_result(user, &res);
+    }
+
+    du_free(a, ls.done);
+    du_free(a, ls.ents);
+    du_free(a, threads);
+    inode_set_destroy(seen);
+    pthread_cond_destroy(&ls.done_cv);
+    pthread_cond_destroy(&ls.work_cv);
+    pthread_mutex_destroy(&ls.mu);
+    return rc;
+}
+
+/* ---------------- Sampling estimator (Knuth random probes) ---------------- */
+
+/*
+ * Each probe walks from the root to a leaf, picking one random subdirectory per
+ * level and weighting the bytes seen at each level by the product of branching
+ * factors so far; the mean over probes is an unbiased estimate of the total.
+ * Directories are read once and cached in a tree. A subtree whose directories
+ * have all been read is "complete": its exact totals are used instead of
+ * sampling into it, so small trees converge to the exact answer. Hardlinks are
+ * deduplicated across the directories actually read, so a complete tree gives
+ * the same total as a full scan.
+ */
+typedef struct EstNode {
+    char *path;
+    struct EstNode *parent;
+    struct EstNode *kids;   /* subdirectories, allocated on expansion */
+    struct EstNode **open;  /* kids not yet complete come first */
+    size_t nkids;
+    size_t ncomplete;
+    size_t slot;            /* index in parent->open */
+    uint64_t own_bytes;     /* regular files directly in this dir */
+    uint64_t own_files;
+    uint64_t done_bytes;    /* totals of complete kids */
+    uint64_t done_files;
+    unsigned char expanded;
+    unsigned char complete; /* whole subtree read; totals = own + done */
+} EstNode;
+
+typedef struct Welford {
+    uint64_t n;
+    double mean;
+    double m2;
+} Welford;
+
+static void welford_add(Welford *w, double x) {
+    w->n++;
+    double d = x - w->mean;
+    w->mean += d / (double)w->n;
+    w->m2 += d * (x - w->mean);
+}
+
+/* Half-width of the 95% confidence interval of the mean. */
+static double welford_ci95(const Welford *w) {
+    if (w->n < 2) return 0.0;
+    return 1.96 * sqrt(w->m2 / (double)(w->n - 1) / (double)w->n);
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void est_free(const DuAllocator *a, EstNode *n) {
+    for (size_t i = 0; i < n->nkids; i++) est_free(a, &n->kids[i]);
+    du_free(a, n->kids);
+    du_free(a, n->open);
+    du_free(a, n->path);
+}
+
+/* Reads one directory level into n. Returns 0, or 1 on OOM. */
+static int est_expand(const DuScan *scan, InodeSet *seen, EstNode *n) {
+    const DuAllocator *a = &scan->alloc;
+    n->expanded = 1;
+
+    DIR *dir = scan_opendir(scan, n->path);
+    if (!dir) {
+        warn_errno(scan, "cannot open directory", n->path);
         return 0;
     }
 
-    char *root_copy = xstrdup(root_path);
-    if (!root_copy || wq_push(&q, root_copy) != 0) {
-        free(root_copy);
-        wq_destroy(&q);
-        pthread_mutex_destroy(&s.seen_mu);
-        pthread_mutex_destroy(&s.total_mu);
-        inode_set_destroy(seen);
-        return 1;
+    size_t cap = 0;
+    int rc = 0;
+    errno = 0;
+    for (struct dirent *de = readdir(dir); de; de = readdir(dir)) {
+        const char *name = de->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+        char *child = path_join_with(a, n->path, name);
+        if (!child) {
+            rc = 1;
+            break;
+        }
+
+        struct stat csb;
+        if (scan_lstat(scan, child, &csb) != 0) {
+            warn_errno(scan, "cannot stat", child);
+            du_free(a, child);
+            errno = 0;
+            continue;
+        }
+
+        if (S_ISREG(csb.st_mode)) {
+            bool inserted = false;
+            if (inode_add_once(seen, &csb, &n->own_bytes, &inserted) != 0) {
+                du_free(a, child);
+                rc = 1;
+                break;
+            }
+            if (inserted) n->own_files++;
+        }
+        if (!S_ISDIR(csb.st_mode)) {
+            du_free(a, child);
+            continue;
+        }
+
+        if (n->nkids == cap) {
+            size_t new_cap = (cap == 0) ? 8 : cap * 2;
+            EstNode *p = (EstNode *)du_realloc(a, n->kids, new_cap * sizeof(EstNode));
+            if (!p) {
+                du_free(a, child);
+                rc = 1;
+                break;
+            }
+            n->kids = p;
+            cap = new_cap;
+        }
+        EstNode *k = &n->kids[n->nkids++];
+        memset(k, 0, sizeof(*k));
+        k->path = child;
     }
 
-    int n = (opt && opt->jobs > 1) ? opt->jobs : 1;
+    if (rc == 0 && errno != 0) warn_errno(scan, "error reading directory", n->path);
+    closedir(dir);
+    if (rc != 0 || n->nkids == 0) return rc;
+
+    n->open = (EstNode **)du_calloc(a, n->nkids, sizeof(EstNode *));
+    if (!n->open) return 1;
+    for (size_t i = 0; i < n->nkids; i++) {
+        n->kids[i].parent = n;
+        n->kids[i].slot = i;
+        n->open[i] = &n->kids[i];
+    }
+    return 0;
+}
 
-    pthread_t *threads = (pthread_t *)calloc((size_t)n, sizeof(pthread_t));
-    WorkerArg *args = (WorkerArg *)calloc((size_t)n, sizeof(WorkerArg));
-    if (!threads || !args) {
-        free(threads);
-        free(args);
-        wq_destroy(&q);
-        pthread_mutex_destroy(&s.seen_mu);
-        pthread_mutex_destroy(&s.total_mu);
-        inode_set_destroy(seen);
-        return 1;
+/* Marks n complete and folds its totals into the ancestors that become complete too. */
+static void est_complete(EstNode *n) {
+    while (n) {
+        n->complete = 1;
+        EstNode *p = n->parent;
+        if (!p) return;
+
+        p->done_bytes += n->own_bytes + n->done_bytes;
+        p->done_files += n->own_files + n->done_files;
+
+        size_t last = p->nkids - p->ncomplete - 1;
+        EstNode *other = p->open[last];
+        p->open[n->slot] = other;
+        other->slot = n->slot;
+        p->open[last] = n;
+        n->slot = last;
+        p->ncomplete++;
+
+        if (p->ncomplete < p->nkids) return;
+        n = p;
     }
+}
 
-    for (int i = 0; i < n; i++) {
-        args[i].shared = &s;
-        args[i].idx = i;
-        if (pthread_create(&threads[i], NULL, worker_main, &args[i]) != 0) {
-            dbg_threads(opt, "pthread_create failed at idx=%d", i);
-            wq_stop_all(&q);
-            n = i;
+/* One probe from the root. Returns 0, or 1 on OOM. */
+static int est_probe(const DuScan *scan, InodeSet *seen, EstNode *root, uint64_t *rng, double *out_bytes,
+                     double *out_files) {
+    double w = 1.0;
+    double bytes = 0.0;
+    double files = 0.0;
+
+    for (EstNode *n = root;;) {
+        if (!n->expanded) {
+            if (est_expand(scan, seen, n) != 0) return 1;
+            if (n->nkids == 0) est_complete(n);
+        }
+        if (n->complete) {
+            bytes += w * (double)(n->own_bytes + n->done_bytes);
+            files += w * (double)(n->own_files + n->done_files);
             break;
         }
+
+        bytes += w * (double)(n->own_bytes + n->done_bytes);
+        files += w * (double)(n->own_files + n->done_files);
+
+        size_t m = n->nkids - n->ncomplete;
+        w *= (double)m;
+        n = n->open[(size_t)(splitmix64(rng) % (uint64_t)m)];
+    }
+
+    *out_bytes = bytes;
+    *out_files = files;
+    return 0;
+}
+
+static int du_sync_estimate(const DuScan *scan, const char *root_path, const DuEstimateOptions *eo,
+                            DuEstimate *out) {
+    const DuAllocator *a = &scan->alloc;
+    memset(out, 0, sizeof(*out));
+
+    struct stat sb;
+    if (scan_lstat(scan, root_path, &sb) != 0) {
+        warn_errno(scan, "cannot stat", root_path);
+        out->exact = true;
+        return 0;
+    }
+    if (!S_ISDIR(sb.st_mode)) {
+        if (S_ISREG(sb.st_mode)) {
+            out->bytes = (double)sb.st_size;
+            out->files = 1.0;
+        }
+        out->exact = true;
+        return 0;
     }
 
-    for (int i = 0; i < n; i++) pthread_join(threads[i], NULL);
+    InodeSet *seen = inode_set_create_with(a);
+    if (!seen) return 1;
+
+    EstNode root;
+    memset(&root, 0, sizeof(root));
+    root.path = xstrdup_with(a, root_path);
+    if (!root.path) {
+        inode_set_destroy(seen);
+        return 1;
+    }
 
-    free(args);
-    free(threads);
+    uint64_t rng = eo->seed ? eo->seed : ((uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32));
+    double start = now_seconds();
+    const uint64_t min_probes = 32;
 
-    *out_bytes = s.total_bytes;
+    Welford wb = {0, 0.0, 0.0};
+    Welford wf = {0, 0.0, 0.0};
+    int rc = 0;
 
-    wq_destroy(&q);
-    pthread_mutex_destroy(&s.seen_mu);
-    pthread_mutex_destroy(&s.total_mu);
+    for (;;) {
+        double pb = 0.0;
+        double pf = 0.0;
+        rc = est_probe(scan, seen, &root, &rng, &pb, &pf);
+        if (rc != 0 || root.complete) break;
+
+        welford_add(&wb, pb);
+        welford_add(&wf, pf);
+
+        if (eo->max_probes && wb.n >= eo->max_probes) break;
+        if (eo->time_budget > 0.0 && now_seconds() - start >= eo->time_budget) break;
+        if (eo->target_rel_error > 0.0 && wb.n >= min_probes && wb.mean > 0.0 &&
+            welford_ci95(&wb) / wb.mean <= eo->target_rel_error)
+            break;
+    }
+
+    if (root.complete) {
+        out->bytes = (double)(root.own_bytes + root.done_bytes);
+        out->files = (double)(root.own_files + root.done_files);
+        out->exact = true;
+    } else {
+        out->bytes = wb.mean;
+        out->bytes_ci95 = welford_ci95(&wb);
+        out->files = wf.mean;
+        out->files_ci95 = welford_ci95(&wf);
+    }
+    out->probes = wb.n;
+
+    est_free(a, &root);
     inode_set_destroy(seen);
-    return 0;
+    return rc;
 }
 
 /* ---------------- Public API ---------------- */
 
-int du_sync_sum_regular_bytes(const char *root_path, const DuOptions *opt, uint64_t *out_bytes) {
-    if (!root_path || !out_bytes) return 2;
+/* du_scan_run on the pool: collects the single root's result. */
+typedef struct OneResult {
+    uint64_t *bytes;
+    GroupMap *groups;
+    int status;
+} OneResult;
+
+static void one_result(void *user, const DuRootResult *r) {
+    OneResult *one = (OneResult *)user;
+    *one->bytes = r->bytes;
+    one->status = r->status;
+    if (one->status == 0 && one->groups && r->groups && group_map_merge(one->groups, r->groups) != 0) one->status = 1;
+}
+
+static int scan_init(DuScan *scan, const DuOptions *opt, const DuCallbacks *cb, const DuAllocator *alloc) {
+    memset(scan, 0, sizeof(*scan));
+    scan->opt.jobs = 1;
+    if (opt) scan->opt = *opt;
+    if (cb) scan->cb = *cb;
+    if (alloc) {
+        int set = (alloc->alloc_fn != NULL) + (alloc->realloc_fn != NULL) + (alloc->free_fn != NULL);
+        if (set != 0 && set != 3) return -1;
+        scan->alloc = *alloc;
+    }
+    return 0;
+}
+
+DuScan *du_scan_create(const DuOptions *opt, const DuCallbacks *cb, const DuAllocator *alloc) {
+    DuScan tmp;
+    if (scan_init(&tmp, opt, cb, alloc) != 0) return NULL;
+
+    DuScan *scan = (DuScan *)du_malloc(&tmp.alloc, sizeof(DuScan));
+    if (!scan) return NULL;
+    *scan = tmp;
+    return scan;
+}
+
+void du_scan_destroy(DuScan *scan) {
+    if (!scan) return;
+    DuAllocator a = scan->alloc;
+    if (scan->counters) du_free(&a, scan->counters->slots_mem);
+    du_free(&a, scan->counters);
+    du_free(&a, scan->throttle);
+    du_free(&a, scan);
+}
 
-    int jobs = 1;
-    if (opt && opt->jobs > 1) jobs = opt->jobs;
+int du_scan_set_throttle(DuScan *scan, const DuThrottle *t) {
+    if (!scan) return 2;
+    if (t && (!(t->stats_per_sec >= 0.0) || !(t->dirs_per_sec >= 0.0) || !(t->slow_stat >= 0.0))) return 2;
 
-    if (jobs <= 1) return du_sync_sum_regular_bytes_sequential(root_path, opt, out_bytes);
-    return du_sync_sum_regular_bytes_parallel(root_path, opt, out_bytes);
+    du_free(&scan->alloc, scan->throttle);
+    scan->throttle = NULL;
+    if (!t || (t->stats_per_sec == 0.0 && t->dirs_per_sec == 0.0 && t->slow_stat == 0.0)) return 0;
+
+    Throttle *th = (Throttle *)du_calloc(&scan->alloc, 1, sizeof(Throttle));
+    if (!th) return 1;
+    th->stat_cost = t->stats_per_sec > 0.0 ? (int64_t)ceil(1e9 / t->stats_per_sec) : 0;
+    th->dir_cost = t->dirs_per_sec > 0.0 ? (int64_t)ceil(1e9 / t->dirs_per_sec) : 0;
+    th->slow_ns = (int64_t)ceil(t->slow_stat * 1e9);
+    scan->throttle = th;
+    return 0;
+}
+
+int du_scan_enable_progress(DuScan *scan) {
+    if (!scan) return 2;
+    if (scan->counters) return 0;
+
+    const DuAllocator *a = &scan->alloc;
+    Counters *c = (Counters *)du_calloc(a, 1, sizeof(Counters));
+    if (!c) return 1;
+    c->nslots = (size_t)(scan->opt.jobs > 1 ? scan->opt.jobs : 1) + 1;
+    c->slots_mem = du_calloc(a, c->nslots + 1, sizeof(CounterSlot));
+    if (!c->slots_mem) {
+        du_free(a, c);
+        return 1;
+    }
+    uintptr_t p = (uintptr_t)c->slots_mem;
+    c->slots = (CounterSlot *)((p + _Alignof(CounterSlot) - 1) & ~(uintptr_t)(_Alignof(CounterSlot) - 1));
+    scan->counters = c;
+    return 0;
+}
+
+void du_scan_progress(const DuScan *scan, DuProgress *out) {
+    memset(out, 0, sizeof(*out));
+    if (!scan || !scan->counters) return;
+
+    const Counters *c = scan->counters;
+    for (size_t i = 0; i < c->nslots; i++) {
+        out->dirs += atomic_load_explicit(&c->slots[i].dirs, memory_order_relaxed);
+        out->files += atomic_load_explicit(&c->slots[i].files, memory_order_relaxed);
+        out->bytes += atomic_load_explicit(&c->slots[i].bytes, memory_order_relaxed);
+    }
+    out->queued = atomic_load_explicit(&c->queued, memory_order_relaxed);
+    out->peak_queued = atomic_load_explicit(&c->peak_queued, memory_order_relaxed);
+}
+
+size_t du_scan_peak_queued(const DuScan *scan) {
+    return scan ? scan->peak_queued : 0;
+}
+
+void du_scan_set_manifest(DuScan *scan, ManifestWriter *w) {
+    if (scan) scan->manifest = w;
+}
+
+void du_scan_set_history(DuScan *scan, const ManifestSizes *h) {
+    if (scan) scan->history = h;
+}
+
+void du_scan_set_checkpoint(DuScan *scan, const char *path, double interval) {
+    if (!scan) return;
+    scan->ckpt_path = path;
+    scan->ckpt_interval = interval;
+}
+
+void du_scan_set_resume(DuScan *scan, const Checkpoint *c) {
+    if (scan) scan->resume = c;
+}
+
+int du_scan_run(DuScan *scan, const char *root_path, uint64_t *out_bytes, GroupMap *groups) {
+    if (!scan || !root_path || !out_bytes || !shard_valid(&scan->opt)) return 2;
+
+    if (scan->opt.group_by == DU_GROUP_NONE) groups = NULL;
+
+    if (scan->opt.jobs <= 1)
+        return du_sync_sum_regular_bytes_sequential(scan, root_path, out_bytes, groups, &scan->peak_queued);
+
+    OneResult one = {.bytes = out_bytes, .groups = groups, .status = 0};
+    CkptRun none = {.scan = scan, .roots = &root_path, .n = 1};
+    *out_bytes = 0;
+    int rc = du_sync_run_many_parallel(scan, &root_path, 1, 1, true, one_result, &one, &none, &scan->peak_queued);
+    return rc ? rc : one.status;
+}
+
+int du_scan_run_many(DuScan *scan, const char *const *roots, size_t n, size_t window, bool ordered,
+                     DuResultFn on_result, void *user) {
+    if (!scan || (n > 0 && !roots) || !shard_valid(&scan->opt)) return 2;
+    if (n == 0) return 0;
+
+    CkptRun ck;
+    int rc = ckpt_init(&ck, scan, roots, n);
+    if (rc != 0) return rc;
+
+    if (scan->opt.jobs > 1) {
+        rc = du_sync_run_many_parallel(scan, roots, n, window, ordered, on_result, user, &ck, &scan->peak_queued);
+        ckpt_finish(&ck, rc);
+        return rc;
+    }
+
+    GroupMap *groups = NULL;
+    if (scan->opt.group_by != DU_GROUP_NONE && !(groups = group_map_create_with(&scan->alloc))) {
+        ckpt_finish(&ck, 1);
+        return 1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t bytes = 0;
+        int st = (rc == 0) ? run_root_sequential(scan, &ck, i, &bytes, groups, &scan->peak_queued) : rc;
+        if (rc == 0 && st != 0) rc = st;
+
+        DuRootResult res = {.index = i, .path = roots[i], .status = st, .bytes = bytes, .groups = groups};
+        if (on_result) on_result(user, &res);
+        group_map_clear(groups);
+        ckpt_delivered(&ck, i, st, bytes);
+        if (rc == 0 && i + 1 < n && ckpt_due(&ck)) ckpt_save_idle(&ck);
+    }
+    group_map_destroy(groups);
+    ckpt_finish(&ck, rc);
+    return rc;
+}
+
+int du_scan_run_list(DuScan *scan, const char *const *paths, size_t n, DuResultFn on_result, void *user,
+                     uint64_t *out_total, GroupMap *groups) {
+    if (!scan || (n > 0 && !paths) || !out_total || scan->opt.shard_count > 1) return 2;
+    *out_total = 0;
+    if (scan->opt.group_by == DU_GROUP_NONE) groups = NULL;
+    if (n == 0) return 0;
+    return du_sync_run_list(scan, paths, n, on_result, user, out_total, groups, &scan->peak_queued);
+}
+
+int du_scan_estimate(DuScan *scan, const char *root_path, const DuEstimateOptions *eo, DuEstimate *out) {
+    if (!scan || !root_path || !eo || !out) return 2;
+    return du_sync_estimate(scan, root_path, eo, out);
+}
+
+int du_sync_sum_grouped(const char *root_path, const DuOptions *opt, uint64_t *out_bytes, GroupMap *groups) {
+    DuScan scan;
+    scan_init(&scan, opt, NULL, NULL);
+    return du_scan_run(&scan, root_path, out_bytes, groups);
+}
+
+int du_sync_sum_regular_bytes(const char *root_path, const DuOptions *opt, uint64_t *out_bytes) {
+    return du_sync_sum_grouped(root_path, opt, out_bytes, NULL);
 }
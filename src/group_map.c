@@ -0,0 +1,183 @@
+#include "group_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct GroupEntry {
+    uint64_t hash;
+    uint64_t id;
+    char *name;
+    size_t name_len;
+    uint64_t bytes;
+    uint64_t files;
+    unsigned char used;
+} GroupEntry;
+
+struct GroupMap {
+    DuAllocator alloc;
+    GroupEntry *tab;
+    size_t cap;
+    size_t len;
+};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t name_hash(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ULL;
+    }
+    return mix64(h);
+}
+
+static int entry_matches(const GroupEntry *e, uint64_t h, uint64_t id, const char *name, size_t name_len) {
+    if (e->hash != h) return 0;
+    if (!name) return !e->name && e->id == id;
+    return e->name && e->name_len == name_len && memcmp(e->name, name, name_len) == 0;
+}
+
+static int group_map_rehash(GroupMap *m, size_t new_cap) {
+    GroupEntry *nt = (GroupEntry *)du_calloc(&m->alloc, new_cap, sizeof(GroupEntry));
+    if (!nt) return -1;
+
+    for (size_t i = 0; i < m->cap; i++) {
+        if (!m->tab[i].used) continue;
+        size_t idx = (size_t)(m->tab[i].hash % (uint64_t)new_cap);
+        while (nt[idx].used) idx = (idx + 1) % new_cap;
+        nt[idx] = m->tab[i];
+    }
+
+    du_free(&m->alloc, m->tab);
+    m->tab = nt;
+    m->cap = new_cap;
+    return 0;
+}
+
+static GroupEntry *group_map_slot(GroupMap *m, uint64_t h, uint64_t id, const char *name, size_t name_len) {
+    if ((m->len + 1) * 10 >= m->cap * 7) {
+        if (group_map_rehash(m, m->cap * 2) != 0) return NULL;
+    }
+
+    size_t idx = (size_t)(h % (uint64_t)m->cap);
+    for (;;) {
+        GroupEntry *e = &m->tab[idx];
+        if (!e->used) {
+            if (name) {
+                e->name = (char *)du_malloc(&m->alloc, name_len + 1);
+                if (!e->name) return NULL;
+                memcpy(e->name, name, name_len);
+                e->name[name_len] = '\0';
+                e->name_len = name_len;
+            }
+            e->used = 1;
+            e->hash = h;
+            e->id = id;
+            m->len++;
+            return e;
+        }
+        if (entry_matches(e, h, id, name, name_len)) return e;
+        idx = (idx + 1) % m->cap;
+    }
+}
+
+GroupMap *group_map_create_with(const DuAllocator *a) {
+    GroupMap *m = (GroupMap *)du_calloc(a, 1, sizeof(GroupMap));
+    if (!m) return NULL;
+    if (a) m->alloc = *a;
+
+    m->cap = 64;
+    m->tab = (GroupEntry *)du_calloc(a, m->cap, sizeof(GroupEntry));
+    if (!m->tab) {
+        du_free(a, m);
+        return NULL;
+    }
+    return m;
+}
+
+GroupMap *group_map_create(void) {
+    return group_map_create_with(NULL);
+}
+
+void group_map_clear(GroupMap *m) {
+    if (!m) return;
+    for (size_t i = 0; i < m->cap; i++) du_free(&m->alloc, m->tab[i].name);
+    memset(m->tab, 0, m->cap * sizeof(GroupEntry));
+    m->len = 0;
+}
+
+void group_map_destroy(GroupMap *m) {
+    if (!m) return;
+    DuAllocator a = m->alloc;
+    group_map_clear(m);
+    du_free(&a, m->tab);
+    du_free(&a, m);
+}
+
+static int group_map_add_entry(GroupMap *m, uint64_t h, uint64_t id, const char *name, size_t name_len,
+                               uint64_t bytes, uint64_t files) {
+    GroupEntry *e = group_map_slot(m, h, id, name, name_len);
+    if (!e) return -1;
+    e->bytes += bytes;
+    e->files += files;
+    return 0;
+}
+
+int group_map_add_id(GroupMap *m, uint64_t id, uint64_t bytes) {
+    return group_map_add_entry(m, mix64(id), id, NULL, 0, bytes, 1);
+}
+
+int group_map_add_name(GroupMap *m, const char *name, size_t name_len, uint64_t bytes) {
+    return group_map_add_entry(m, name_hash(name, name_len), 0, name, name_len, bytes, 1);
+}
+
+int group_map_merge(GroupMap *dst, const GroupMap *src) {
+    for (size_t i = 0; i < src->cap; i++) {
+        const GroupEntry *e = &src->tab[i];
+        if (!e->used) continue;
+        if (group_map_add_entry(dst, e->hash, e->id, e->name, e->name_len, e->bytes, e->files) != 0) return -1;
+    }
+    return 0;
+}
+
+static int row_cmp(const void *a, const void *b) {
+    const GroupRow *ra = (const GroupRow *)a;
+    const GroupRow *rb = (const GroupRow *)b;
+    if (ra->bytes != rb->bytes) return (ra->bytes < rb->bytes) ? 1 : -1;
+    if (ra->name && rb->name) return strcmp(ra->name, rb->name);
+    return (ra->id > rb->id) - (ra->id < rb->id);
+}
+
+GroupRow *group_map_rows(const GroupMap *m, size_t *out_len) {
+    *out_len = 0;
+    if (!m || m->len == 0) return NULL;
+
+    GroupRow *rows = (GroupRow *)du_malloc(&m->alloc, m->len * sizeof(GroupRow));
+    if (!rows) return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < m->cap; i++) {
+        const GroupEntry *e = &m->tab[i];
+        if (!e->used) continue;
+        rows[n].id = e->id;
+        rows[n].name = e->name;
+        rows[n].bytes = e->bytes;
+        rows[n].files = e->files;
+        n++;
+    }
+
+    qsort(rows, n, sizeof(GroupRow), row_cmp);
+    *out_len = n;
+    return rows;
+}
+
+void group_map_rows_free(const GroupMap *m, GroupRow *rows) {
+    if (m) du_free(&m->alloc, rows);
+}
@@ -10,6 +10,7 @@ typedef struct Entry {
 } Entry;
 
 struct InodeSet {
+    DuAllocator alloc;
     Entry *tab;
     size_t cap;
     size_t len;
@@ -38,7 +39,7 @@ static int inode_set_rehash(InodeSet *s, size_t new_cap) {
     Entry *old = s->tab;
     size_t old_cap = s->cap;
 
-    Entry *nt = (Entry *)calloc(new_cap, sizeof(Entry));
+    Entry *nt = (Entry *)du_calloc(&s->alloc, new_cap, sizeof(Entry));
     if (!nt) return -1;
 
     s->tab = nt;
@@ -62,28 +63,34 @@ static int inode_set_rehash(InodeSet *s, size_t new_cap) {
         }
     }
 
-    free(old);
+    du_free(&s->alloc, old);
     return 0;
 }
 
-InodeSet *inode_set_create(void) {
-    InodeSet *s = (InodeSet *)calloc(1, sizeof(InodeSet));
+InodeSet *inode_set_create_with(const DuAllocator *a) {
+    InodeSet *s = (InodeSet *)du_calloc(a, 1, sizeof(InodeSet));
     if (!s) return NULL;
+    if (a) s->alloc = *a;
 
     s->cap = 1024;
-    s->tab = (Entry *)calloc(s->cap, sizeof(Entry));
+    s->tab = (Entry *)du_calloc(a, s->cap, sizeof(Entry));
     if (!s->tab) {
-        free(s);
+        du_free(a, s);
         return NULL;
     }
     s->len = 0;
     return s;
 }
 
+InodeSet *inode_set_create(void) {
+    return inode_set_create_with(NULL);
+}
+
 void inode_set_destroy(InodeSet *set) {
     if (!set) return;
-    free(set->tab);
-    free(set);
+    DuAllocator a = set->alloc;
+    du_free(&a, set->tab);
+    du_free(&a, set);
 }
 
 bool inode_set_insert(InodeSet *s, InodeKey key, bool *oom) {
@@ -114,3 +121,17 @@ bool inode_set_insert(InodeSet *s, InodeKey key, bool *oom) {
         idx = (idx + 1) % s->cap;
     }
 }
+
+size_t inode_set_size(const InodeSet *s) {
+    return s ? s->len : 0;
+}
+
+bool inode_set_next(const InodeSet *s, size_t *pos, InodeKey *out) {
+    for (size_t i = *pos; s && i < s->cap; i++) {
+        if (!s->tab[i].used) continue;
+        *out = s->tab[i].key;
+        *pos = i + 1;
+        return true;
+    }
+    return false;
+}
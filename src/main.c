@@ -1,49 +1,269 @@
 #include "du_sync.h"
 
+#include "background.h"
+#include "out_buf.h"
 #include "path_util.h"
+#include "progress.h"
+#include "shard.h"
 #include "strvec.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static void usage(FILE *out) {
     fprintf(out,
             "Usage: du-sync [OPTIONS] [PATH...]\n"
+            "       du-sync diff MANIFEST_A MANIFEST_B\n"
+            "       du-sync merge SHARD_FILE...\n"
             "Sums sizes (bytes) of regular files under each PATH.\n"
             "\n"
             "Options:\n"
             "  -0                  Read NUL-delimited paths from stdin (only with '-' arg or piped stdin)\n"
             "  -q                  Quiet (suppress warnings)\n"
+            "  -c, --total          With --files0-from, also print the grand total\n"
             "  -j, --jobs N         Use N worker threads for parallel traversal (default: 1)\n"
             "      --debug-threads  Print worker thread activity to stderr\n"
+            "      --group-by KEY   Also print bytes/files per uid, gid, ext or age (mtime bucket)\n"
+            "      --estimate[=SECS]  Estimate by random sampling within SECS (default: 10) and print a 95%% CI\n"
+            "      --estimate-error PCT  Stop estimating once the CI half-width is within PCT%% (default: 1)\n"
+            "      --manifest FILE  Record every directory and file into a binary manifest FILE\n"
+            "      --unordered      With -j, print each PATH as soon as it is done instead of in input order\n"
+            "      --reorder-window N  With -j, scan up to N PATHs concurrently (default: 256)\n"
+            "      --max-queue N    With -j, queue at most N directories; beyond that workers descend\n"
+            "                       depth-first inline (default: 65536, 0: unbounded)\n"
+            "      --split-dir N    With -j, share the entries of directories larger than N among all\n"
+            "                       workers (default: 10000, 0: never)\n"
+            "      --schedule POLICY  With -j, read directories in discovery order (fifo) or largest\n"
+            "                       estimated subtree first (largest, the default)\n"
+            "      --history FILE   Estimate subtree sizes from a previous --manifest FILE\n"
+            "      --checkpoint FILE  Save the scan state to FILE periodically (removed when the scan completes)\n"
+            "      --checkpoint-interval SECS  Seconds between checkpoints (default: 60)\n"
+            "      --resume FILE    Continue the scan saved in checkpoint FILE (same PATHs)\n"
+            "      --shard I/N      Scan only part I of N of each PATH (directories at --shard-level are\n"
+            "                       divided by a hash of their path) and write it to --shard-out FILE\n"
+            "      --shard-level K  Depth of the directories divided among shards (default: 1)\n"
+            "      --shard-out FILE  Shard result file for `du-sync merge`\n"
+            "      --background     Run at idle CPU and I/O priority and back off when stats slow down\n"
+            "                       (implies --slow-stat 10)\n"
+            "      --max-stats N    Perform at most N stats per second (all threads together)\n"
+            "      --max-dirs N     Open at most N directories per second (all threads together)\n"
+            "      --slow-stat MS   Back off while stats take more than MS milliseconds on average\n"
+            "      --files0-from F  Read NUL-delimited paths from F ('-' for stdin) as one file list: one lstat\n"
+            "                       per path, hardlinks counted once across the whole list\n"
+            "      --total-only     With --files0-from, print only the grand total\n"
+            "      --progress[=SECS]  Print a progress line to stderr every SECS (default: 10; 0: only on SIGUSR1)\n"
+            "                       and whenever SIGUSR1 is received\n"
+            "      --progress-file FILE  Write the progress line to FILE (replaced atomically) instead of stderr\n"
             "  -h, --help           Show this help\n"
             "  -V, --version        Show version\n"
             "\n"
             "Input via stdin:\n"
             "  If PATH is '-', read paths from stdin.\n"
-            "  If no PATH given and stdin is not a TTY, read paths from stdin.\n");
+            "  If no PATH given and stdin is not a TTY, read paths from stdin.\n"
+            "\n"
+            "diff prints \"<delta>\\t<bytes_a>\\t<bytes_b>\\t<dir>\" for every directory whose\n"
+            "recursive size differs between two manifests, without touching the filesystem.\n"
+            "\n"
+            "merge combines the --shard-out files of shards 1/N .. N/N of one run and prints\n"
+            "\"<bytes>\\t<path>\" per PATH, counting files hardlinked across shards once. PATHs are\n"
+            "matched by position, so each shard may reach the tree under its own mount path.\n");
 }
 
 static void version(FILE *out) {
     fprintf(out, "du-sync 1.1.1\n");
 }
 
-static int print_one(const char *path, const DuOptions *opt) {
-    uint64_t bytes = 0;
-    int rc = du_sync_sum_regular_bytes(path, opt, &bytes);
+static const char *group_kind_name(DuGroupBy g) {
+    switch (g) {
+        case DU_GROUP_UID:
+            return "uid";
+        case DU_GROUP_GID:
+            return "gid";
+        case DU_GROUP_EXT:
+            return "ext";
+        case DU_GROUP_AGE:
+            return "age";
+        case DU_GROUP_NONE:
+        default:
+            return "";
+    }
+}
+
+static int parse_group_by(const char *s, DuGroupBy *out) {
+    static const DuGroupBy kinds[] = {DU_GROUP_UID, DU_GROUP_GID, DU_GROUP_EXT, DU_GROUP_AGE};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (s && strcmp(s, group_kind_name(kinds[i])) == 0) {
+            *out = kinds[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Group rows follow the total line, indented: "  <bytes>\t<files>\t<kind>=<key>". */
+static void print_groups(OutBuf *out, const GroupMap *groups, DuGroupBy g) {
+    size_t n = 0;
+    GroupRow *rows = group_map_rows(groups, &n);
+    const char *kind = group_kind_name(g);
+
+    for (size_t i = 0; i < n; i++) {
+        out_buf_printf(out, "  %" PRIu64 "\t%" PRIu64 "\t%s=", rows[i].bytes, rows[i].files, kind);
+        if (g == DU_GROUP_EXT) out_buf_printf(out, "%s\n", rows[i].name);
+        else if (g == DU_GROUP_AGE) out_buf_printf(out, "%s\n", du_sync_age_bucket_name(rows[i].id));
+        else out_buf_printf(out, "%" PRIu64 "\n", rows[i].id);
+    }
+    group_map_rows_free(groups, rows);
+}
+
+/*
+ * Estimate rows follow the line with the point estimate:
+ *   "  <bytes>\t<files>\tci95-low" / "ci95-high" and "  <probes>\tprobes" (or "exact").
+ */
+static int print_estimate(OutBuf *out, DuScan *scan, const char *path, const DuEstimateOptions *eo) {
+    DuEstimate est;
+    int rc = du_scan_estimate(scan, path, eo, &est);
     if (rc != 0) return rc;
-    printf("%" PRIu64 "\t%s\n", bytes, path);
+
+    out_buf_printf(out, "%.0f\t%s\n", est.bytes, path);
+    if (est.exact) {
+        out_buf_printf(out, "  %.0f\t%.0f\texact\n", est.bytes, est.files);
+        out_buf_end_record(out);
+        return 0;
+    }
+
+    double lo_b = est.bytes - est.bytes_ci95;
+    double lo_f = est.files - est.files_ci95;
+    out_buf_printf(out, "  %.0f\t%.0f\tci95-low\n", lo_b > 0.0 ? lo_b : 0.0, lo_f > 0.0 ? lo_f : 0.0);
+    out_buf_printf(out, "  %.0f\t%.0f\tci95-high\n", est.bytes + est.bytes_ci95, est.files + est.files_ci95);
+    out_buf_printf(out, "  %" PRIu64 "\tprobes\n", est.probes);
+    out_buf_end_record(out);
     return 0;
 }
 
+/* Error callback for the library calls outside a scan, in the scan's message format. */
+static void print_error(void *user, const char *msg, const char *path, int errnum) {
+    (void)user;
+    if (errnum) fprintf(stderr, "du-sync: %s: %s: %s\n", msg, path, strerror(errnum));
+    else fprintf(stderr, "du-sync: %s: %s\n", msg, path);
+}
+
+typedef struct PrintCtx {
+    OutBuf *out;
+    DuGroupBy group_by;
+    ShardFile *shard; /* --shard-out, or NULL */
+    int exit_code;
+} PrintCtx;
+
+/* Result callback of du_scan_run_many: runs on the main thread, one root at a time. */
+static void print_result(void *user, const DuRootResult *r) {
+    PrintCtx *pc = (PrintCtx *)user;
+    if (pc->shard) shard_file_add_root(pc->shard, r);
+    if (r->status != 0) {
+        pc->exit_code = 1;
+        return;
+    }
+    out_buf_printf(pc->out, "%" PRIu64 "\t%s\n", r->bytes, r->path);
+    if (r->groups) print_groups(pc->out, r->groups, pc->group_by);
+    out_buf_end_record(pc->out);
+}
+
 static int add_stdin_paths(StrVec *paths, int nul_delim) {
     int delim = nul_delim ? '\0' : '\n';
     return strvec_read_from_stdin(paths, delim);
 }
 
+/* File-list mode: per-entry lines (unless total_only), then "<total>\ttotal" and group rows. */
+static int run_file_list(OutBuf *out, DuScan *scan, const StrVec *paths, const DuOptions *opt, bool total,
+                         bool total_only) {
+    GroupMap *groups = NULL;
+    if (opt->group_by != DU_GROUP_NONE) {
+        groups = group_map_create();
+        if (!groups) return 1;
+    }
+
+    PrintCtx pc = {.out = out, .group_by = DU_GROUP_NONE, .shard = NULL, .exit_code = 0};
+    uint64_t sum = 0;
+    const char *const *list = (const char *const *)paths->items;
+    int rc = du_scan_run_list(scan, list, paths->len, total_only ? NULL : print_result, &pc, &sum, groups);
+    if (rc == 0 && (total || total_only)) {
+        out_buf_printf(out, "%" PRIu64 "\ttotal\n", sum);
+        if (groups) print_groups(out, groups, opt->group_by);
+        out_buf_end_record(out);
+    }
+    group_map_destroy(groups);
+    return (rc != 0 || pc.exit_code != 0) ? 1 : 0;
+}
+
+static int read_files0_from(StrVec *paths, const char *file) {
+    if (strcmp(file, "-") == 0) return add_stdin_paths(paths, 1) != 0 ? 1 : 0;
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "du-sync: cannot open file list: %s: %s\n", file, strerror(errno));
+        return 2;
+    }
+    int rc = strvec_read_fd(paths, fd, '\0');
+    close(fd);
+    return rc != 0 ? 1 : 0;
+}
+
+static int parse_positive_double(const char *s, double *out) {
+    if (!s || !*s) return -1;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (!end || *end != '\0' || !(v > 0.0)) return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_interval(const char *s, double *out) {
+    if (!s || !*s) return -1;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (!end || *end != '\0' || !(v >= 0.0) || v > 86400.0) return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_count(const char *s, size_t *out) {
+    if (!s || !*s || *s == '-') return -1;
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (!end || *end != '\0' || errno != 0 || v > SIZE_MAX) return -1;
+    *out = (size_t)v;
+    return 0;
+}
+
+static int parse_window(const char *s, size_t *out) {
+    if (!s || !*s) return -1;
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (!end || *end != '\0' || v < 1 || v > (1ULL << 20)) return -1;
+    *out = (size_t)v;
+    return 0;
+}
+
+/* "I/N", 1 <= I <= N <= 65536; *index is 0-based. */
+static int parse_shard(const char *s, unsigned *index, unsigned *count) {
+    if (!s || !*s || *s == '-') return -1;
+    char *end = NULL;
+    unsigned long i = strtoul(s, &end, 10);
+    if (!end || *end != '/' || end[1] == '-') return -1;
+    unsigned long n = strtoul(end + 1, &end, 10);
+    if (!end || *end != '\0' || i < 1 || i > n || n > 65536) return -1;
+    *index = (unsigned)(i - 1);
+    *count = (unsigned)n;
+    return 0;
+}
+
 static int parse_jobs(const char *s) {
     if (!s || !*s) return -1;
     char *end = NULL;
@@ -53,21 +273,100 @@ static int parse_jobs(const char *s) {
     return (int)v;
 }
 
+static int run_diff(int argc, char **argv) {
+    if (argc != 4) {
+        usage(stderr);
+        return 2;
+    }
+    return manifest_diff(argv[2], argv[3], stdout);
+}
+
+static int run_merge(int argc, char **argv) {
+    if (argc < 3) {
+        usage(stderr);
+        return 2;
+    }
+    return shard_merge((const char *const *)argv + 2, (size_t)(argc - 2), stdout);
+}
+
 int main(int argc, char **argv) {
-    DuOptions opt = {.quiet = false, .stdin_nul = false, .jobs = 1, .debug_threads = false};
+    if (argc > 1 && strcmp(argv[1], "diff") == 0) return run_diff(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "merge") == 0) return run_merge(argc, argv);
+
+    DuOptions opt = {.quiet = false,
+                     .stdin_nul = false,
+                     .jobs = 1,
+                     .debug_threads = false,
+                     .group_by = DU_GROUP_NONE,
+                     .max_queued = 65536,
+                     .split_entries = 10000,
+                     .schedule = DU_SCHEDULE_LARGEST_FIRST,
+                     .shard_index = 0,
+                     .shard_count = 0,
+                     .shard_level = 1};
+
+    const char *manifest_path = NULL;
+    bool estimate = false;
+    bool ordered = true;
+    size_t window = 256;
+    const char *files0_from = NULL;
+    bool total = false;
+    bool total_only = false;
+    bool progress = false;
+    double progress_interval = 10.0;
+    const char *progress_file = NULL;
+    const char *history_path = NULL;
+    const char *checkpoint_path = NULL;
+    double checkpoint_interval = 60.0;
+    const char *resume_path = NULL;
+    const char *shard_path = NULL;
+    bool background = false;
+    DuThrottle throttle = {.stats_per_sec = 0.0, .dirs_per_sec = 0.0, .slow_stat = 0.0};
+    bool slow_stat_set = false;
+    DuEstimateOptions est = {.time_budget = 10.0, .target_rel_error = 0.01, .max_probes = 0, .seed = 0};
 
-    enum { OPT_DEBUG_THREADS = 1000 };
+    enum { OPT_DEBUG_THREADS = 1000, OPT_GROUP_BY, OPT_ESTIMATE, OPT_ESTIMATE_ERROR, OPT_MANIFEST, OPT_UNORDERED,
+           OPT_REORDER_WINDOW, OPT_FILES0_FROM, OPT_TOTAL_ONLY,
+           OPT_PROGRESS, OPT_PROGRESS_FILE, OPT_MAX_QUEUE,
+           OPT_SPLIT_DIR, OPT_SCHEDULE, OPT_HISTORY, OPT_CHECKPOINT, OPT_CHECKPOINT_INTERVAL, OPT_RESUME,
+           OPT_SHARD, OPT_SHARD_LEVEL, OPT_SHARD_OUT, OPT_BACKGROUND, OPT_MAX_STATS, OPT_MAX_DIRS,
+           OPT_SLOW_STAT };
 
     static const struct option long_opts[] = {
         {"help", no_argument, NULL, 'h'},
         {"version", no_argument, NULL, 'V'},
         {"jobs", required_argument, NULL, 'j'},
         {"debug-threads", no_argument, NULL, OPT_DEBUG_THREADS},
+        {"group-by", required_argument, NULL, OPT_GROUP_BY},
+        {"estimate", optional_argument, NULL, OPT_ESTIMATE},
+        {"estimate-error", required_argument, NULL, OPT_ESTIMATE_ERROR},
+        {"manifest", required_argument, NULL, OPT_MANIFEST},
+        {"unordered", no_argument, NULL, OPT_UNORDERED},
+        {"reorder-window", required_argument, NULL, OPT_REORDER_WINDOW},
+        {"files0-from", required_argument, NULL, OPT_FILES0_FROM},
+        {"total", no_argument, NULL, 'c'},
+        {"total-only", no_argument, NULL, OPT_TOTAL_ONLY},
+        {"progress", optional_argument, NULL, OPT_PROGRESS},
+        {"progress-file", required_argument, NULL, OPT_PROGRESS_FILE},
+        {"max-queue", required_argument, NULL, OPT_MAX_QUEUE},
+        {"split-dir", required_argument, NULL, OPT_SPLIT_DIR},
+        {"schedule", required_argument, NULL, OPT_SCHEDULE},
+        {"history", required_argument, NULL, OPT_HISTORY},
+        {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+        {"checkpoint-interval", required_argument, NULL, OPT_CHECKPOINT_INTERVAL},
+        {"resume", required_argument, NULL, OPT_RESUME},
+        {"shard", required_argument, NULL, OPT_SHARD},
+        {"shard-level", required_argument, NULL, OPT_SHARD_LEVEL},
+        {"shard-out", required_argument, NULL, OPT_SHARD_OUT},
+        {"background", no_argument, NULL, OPT_BACKGROUND},
+        {"max-stats", required_argument, NULL, OPT_MAX_STATS},
+        {"max-dirs", required_argument, NULL, OPT_MAX_DIRS},
+        {"slow-stat", required_argument, NULL, OPT_SLOW_STAT},
         {0, 0, 0, 0},
     };
 
     for (;;) {
-        int c = getopt_long(argc, argv, "0qhj:V", long_opts, NULL);
+        int c = getopt_long(argc, argv, "0cqhj:V", long_opts, NULL);
         if (c == -1) break;
 
         switch (c) {
@@ -77,6 +376,9 @@ int main(int argc, char **argv) {
             case 'q':
                 opt.quiet = true;
                 break;
+            case 'c':
+                total = true;
+                break;
             case 'j': {
                 int j = parse_jobs(optarg);
                 if (j < 1) {
@@ -89,6 +391,135 @@ int main(int argc, char **argv) {
             case OPT_DEBUG_THREADS:
                 opt.debug_threads = true;
                 break;
+            case OPT_GROUP_BY:
+                if (parse_group_by(optarg, &opt.group_by) != 0) {
+                    fprintf(stderr, "du-sync: invalid group-by key: %s (expected uid, gid, ext or age)\n",
+                            optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_ESTIMATE:
+                estimate = true;
+                if (optarg && parse_positive_double(optarg, &est.time_budget) != 0) {
+                    fprintf(stderr, "du-sync: invalid estimate time budget: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case OPT_ESTIMATE_ERROR:
+                if (parse_positive_double(optarg, &est.target_rel_error) != 0) {
+                    fprintf(stderr, "du-sync: invalid estimate error: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                est.target_rel_error /= 100.0;
+                break;
+            case OPT_MANIFEST:
+                manifest_path = optarg;
+                break;
+            case OPT_UNORDERED:
+                ordered = false;
+                break;
+            case OPT_REORDER_WINDOW:
+                if (parse_window(optarg, &window) != 0) {
+                    fprintf(stderr, "du-sync: invalid reorder window: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_FILES0_FROM:
+                files0_from = optarg;
+                break;
+            case OPT_TOTAL_ONLY:
+                total_only = true;
+                break;
+            case OPT_PROGRESS:
+                progress = true;
+                if (optarg && parse_interval(optarg, &progress_interval) != 0) {
+                    fprintf(stderr, "du-sync: invalid progress interval: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case OPT_MAX_QUEUE:
+                if (parse_count(optarg, &opt.max_queued) != 0) {
+                    fprintf(stderr, "du-sync: invalid max-queue value: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_SPLIT_DIR:
+                if (parse_count(optarg, &opt.split_entries) != 0) {
+                    fprintf(stderr, "du-sync: invalid split-dir value: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_SCHEDULE:
+                if (optarg && strcmp(optarg, "fifo") == 0) {
+                    opt.schedule = DU_SCHEDULE_FIFO;
+                } else if (optarg && strcmp(optarg, "largest") == 0) {
+                    opt.schedule = DU_SCHEDULE_LARGEST_FIRST;
+                } else {
+                    fprintf(stderr, "du-sync: invalid schedule: %s (expected fifo or largest)\n",
+                            optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_HISTORY:
+                history_path = optarg;
+                break;
+            case OPT_CHECKPOINT:
+                checkpoint_path = optarg;
+                break;
+            case OPT_CHECKPOINT_INTERVAL:
+                if (parse_positive_double(optarg, &checkpoint_interval) != 0) {
+                    fprintf(stderr, "du-sync: invalid checkpoint interval: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_RESUME:
+                resume_path = optarg;
+                break;
+            case OPT_SHARD:
+                if (parse_shard(optarg, &opt.shard_index, &opt.shard_count) != 0) {
+                    fprintf(stderr, "du-sync: invalid shard: %s (expected I/N)\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_SHARD_LEVEL: {
+                size_t k = 0;
+                if (parse_count(optarg, &k) != 0 || k < 1 || k > 4096) {
+                    fprintf(stderr, "du-sync: invalid shard level: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                opt.shard_level = (unsigned)k;
+                break;
+            }
+            case OPT_SHARD_OUT:
+                shard_path = optarg;
+                break;
+            case OPT_BACKGROUND:
+                background = true;
+                break;
+            case OPT_MAX_STATS:
+                if (parse_positive_double(optarg, &throttle.stats_per_sec) != 0) {
+                    fprintf(stderr, "du-sync: invalid max-stats value: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_MAX_DIRS:
+                if (parse_positive_double(optarg, &throttle.dirs_per_sec) != 0) {
+                    fprintf(stderr, "du-sync: invalid max-dirs value: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                break;
+            case OPT_SLOW_STAT:
+                if (parse_positive_double(optarg, &throttle.slow_stat) != 0) {
+                    fprintf(stderr, "du-sync: invalid slow-stat value: %s\n", optarg ? optarg : "(null)");
+                    return 2;
+                }
+                throttle.slow_stat /= 1000.0;
+                slow_stat_set = true;
+                break;
+            case OPT_PROGRESS_FILE:
+                progress = true;
+                progress_file = optarg;
+                break;
             case 'h':
                 usage(stdout);
                 return 0;
@@ -101,51 +532,202 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (manifest_path && estimate) {
+        fprintf(stderr, "du-sync: --manifest cannot be combined with --estimate\n");
+        return 2;
+    }
+
+    if (files0_from && (estimate || manifest_path || optind < argc)) {
+        fprintf(stderr, "du-sync: --files0-from cannot be combined with PATHs, --estimate or --manifest\n");
+        return 2;
+    }
+    if ((total || total_only) && !files0_from) {
+        fprintf(stderr, "du-sync: -c and --total-only require --files0-from\n");
+        return 2;
+    }
+    if ((checkpoint_path || resume_path) &&
+        (files0_from || estimate || manifest_path || opt.group_by != DU_GROUP_NONE)) {
+        fprintf(stderr,
+                "du-sync: --checkpoint and --resume cannot be combined with --files0-from, --estimate, --manifest or "
+                "--group-by\n");
+        return 2;
+    }
+
+    if (opt.shard_count > 0 || shard_path) {
+        if (opt.shard_count == 0 || !shard_path) {
+            fprintf(stderr, "du-sync: --shard and --shard-out must be given together\n");
+            return 2;
+        }
+        if (files0_from || estimate || checkpoint_path || resume_path || opt.group_by != DU_GROUP_NONE) {
+            fprintf(stderr, "du-sync: --shard cannot be combined with --files0-from, --estimate, --group-by, "
+                            "--checkpoint or --resume\n");
+            return 2;
+        }
+    }
+
+    /* Everything acquired below is released at `out`, in reverse order. */
+    int exit_code = 0;
     StrVec paths;
     strvec_init(&paths);
+    ShardFile *shard = NULL;
+    DuScan *scan = NULL;
+    OutBuf out = {.fd = STDOUT_FILENO};
+    ManifestSizes *history = NULL;
+    Checkpoint *resume = NULL;
+    ManifestWriter *manifest = NULL;
 
     int have_arg_paths = (optind < argc);
 
-    if (!have_arg_paths && !stdin_is_tty()) {
+    if (files0_from) {
+        exit_code = read_files0_from(&paths, files0_from);
+        if (exit_code != 0) {
+            if (exit_code == 1) fprintf(stderr, "du-sync: out of memory while reading file list\n");
+            goto out;
+        }
+    } else if (!have_arg_paths && !stdin_is_tty()) {
         if (add_stdin_paths(&paths, opt.stdin_nul) != 0) {
             fprintf(stderr, "du-sync: out of memory while reading stdin\n");
-            strvec_destroy(&paths);
-            return 1;
+            exit_code = 1;
+            goto out;
         }
     } else if (!have_arg_paths) {
         char *dot = xstrdup(".");
         if (!dot || strvec_push(&paths, dot) != 0) {
             free(dot);
             fprintf(stderr, "du-sync: out of memory\n");
-            strvec_destroy(&paths);
-            return 1;
+            exit_code = 1;
+            goto out;
         }
     } else {
         for (int i = optind; i < argc; i++) {
             if (strcmp(argv[i], "-") == 0) {
                 if (add_stdin_paths(&paths, opt.stdin_nul) != 0) {
                     fprintf(stderr, "du-sync: out of memory while reading stdin\n");
-                    strvec_destroy(&paths);
-                    return 1;
+                    exit_code = 1;
+                    goto out;
                 }
             } else {
                 char *p = xstrdup(argv[i]);
                 if (!p || strvec_push(&paths, p) != 0) {
                     free(p);
                     fprintf(stderr, "du-sync: out of memory\n");
-                    strvec_destroy(&paths);
-                    return 1;
+                    exit_code = 1;
+                    goto out;
                 }
             }
         }
     }
 
-    int exit_code = 0;
-    for (size_t i = 0; i < paths.len; i++) {
-        int rc = print_one(paths.items[i], &opt);
-        if (rc != 0) exit_code = 1;
+    /* Before any thread exists, so that the workers inherit the priority. */
+    if (background) {
+        if (background_enter() != 0 && !opt.quiet)
+            fprintf(stderr, "du-sync: cannot fully lower priority: %s\n", strerror(errno));
+        if (!slow_stat_set) throttle.slow_stat = 0.010;
+    }
+
+    /* Before any thread exists, so that only the reporter takes SIGUSR1. */
+    if (progress && progress_block_signal() != 0) {
+        fprintf(stderr, "du-sync: cannot block SIGUSR1\n");
+        exit_code = 1;
+        goto out;
+    }
+
+    if (shard_path && !(shard = shard_file_create(shard_path, opt.shard_index, opt.shard_count, opt.shard_level,
+                                                  (uint64_t)paths.len))) {
+        fprintf(stderr, "du-sync: cannot create shard file: %s: %s\n", shard_path, strerror(errno));
+        exit_code = 1;
+        goto out;
+    }
+
+    DuCallbacks cb = {.on_error = NULL, .on_entry = shard ? shard_file_note_entry : NULL, .user = shard};
+    scan = du_scan_create(&opt, &cb, NULL);
+    if (!scan || (progress && du_scan_enable_progress(scan) != 0) || du_scan_set_throttle(scan, &throttle) != 0 ||
+        out_buf_init(&out, STDOUT_FILENO, 1u << 20) != 0) {
+        fprintf(stderr, "du-sync: out of memory\n");
+        exit_code = 1;
+        goto out;
     }
 
+    /* The history stays mapped during the scan, so it must not be the manifest being rewritten. */
+    if (history_path) {
+        struct stat hs;
+        struct stat ms;
+        if (manifest_path && stat(history_path, &hs) == 0 && stat(manifest_path, &ms) == 0 &&
+            hs.st_dev == ms.st_dev && hs.st_ino == ms.st_ino) {
+            fprintf(stderr, "du-sync: --history and --manifest must be different files\n");
+            exit_code = 2;
+            goto out;
+        }
+        if (!(history = manifest_sizes_open(history_path))) {
+            fprintf(stderr, "du-sync: cannot use scan history: %s\n", history_path);
+            exit_code = 1;
+            goto out;
+        }
+        du_scan_set_history(scan, history);
+    }
+
+    if (resume_path) {
+        const char *const *roots = (const char *const *)paths.items;
+        DuCallbacks report = {.on_error = print_error, .on_entry = NULL, .user = NULL};
+        if (!(resume = checkpoint_open(resume_path, NULL, &report))) {
+            exit_code = 1;
+            goto out;
+        }
+        if (!checkpoint_matches(resume, roots, paths.len)) {
+            fprintf(stderr, "du-sync: checkpoint was saved for other paths: %s\n", resume_path);
+            exit_code = 2;
+            goto out;
+        }
+        du_scan_set_resume(scan, resume);
+    }
+    if (checkpoint_path) du_scan_set_checkpoint(scan, checkpoint_path, checkpoint_interval);
+
+    if (manifest_path) {
+        if (!(manifest = manifest_writer_open(manifest_path, NULL))) {
+            fprintf(stderr, "du-sync: cannot create manifest: %s: %s\n", manifest_path, strerror(errno));
+            exit_code = 1;
+            goto out;
+        }
+        du_scan_set_manifest(scan, manifest);
+    }
+
+    ProgressReporter *reporter = NULL;
+    if (progress) {
+        reporter = progress_start(scan, progress_interval, progress_file);
+        if (!reporter) fprintf(stderr, "du-sync: cannot start progress reporter: %s\n", strerror(errno));
+    }
+
+    if (files0_from) {
+        exit_code = run_file_list(&out, scan, &paths, &opt, total, total_only);
+    } else if (estimate) {
+        for (size_t i = 0; i < paths.len; i++) {
+            if (print_estimate(&out, scan, paths.items[i], &est) != 0) exit_code = 1;
+        }
+    } else {
+        PrintCtx pc = {.out = &out, .group_by = opt.group_by, .shard = shard, .exit_code = 0};
+        const char *const *roots = (const char *const *)paths.items;
+        if (du_scan_run_many(scan, roots, paths.len, window, ordered, print_result, &pc) != 0) exit_code = 1;
+        if (pc.exit_code != 0) exit_code = 1;
+    }
+
+    progress_stop(reporter);
+
+out:
+    if (manifest && manifest_writer_close(manifest) != 0) {
+        fprintf(stderr, "du-sync: error writing manifest: %s: %s\n", manifest_path, strerror(errno));
+        exit_code = 1;
+    }
+    checkpoint_close(resume);
+    manifest_sizes_close(history);
+    if (out_buf_destroy(&out) != 0) {
+        fprintf(stderr, "du-sync: error writing output: %s\n", strerror(errno));
+        exit_code = 1;
+    }
+    du_scan_destroy(scan);
+    if (shard && shard_file_close(shard) != 0) {
+        fprintf(stderr, "du-sync: error writing shard file: %s: %s\n", shard_path, strerror(errno));
+        exit_code = 1;
+    }
     strvec_destroy(&paths);
     return exit_code;
 }
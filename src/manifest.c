@@ -0,0 +1,584 @@
+#define _XOPEN_SOURCE 700
+
+#include "manifest.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MANIFEST_MAGIC "DUSYNCM1"
+#define MANIFEST_VERSION 1u
+#define MANIFEST_HEADER_SIZE 16u
+#define MANIFEST_RECORD_FIXED 52u
+#define MANIFEST_BLOCK_SIZE ((size_t)1 << 20)
+#define MANIFEST_MAX_QUEUED 16
+
+/* ---------------- Writer ---------------- */
+
+struct ManifestBlock {
+    struct ManifestBlock *next;
+    size_t len;
+    unsigned char data[MANIFEST_BLOCK_SIZE];
+};
+
+struct ManifestWriter {
+    DuAllocator alloc;
+    int fd;
+    pthread_t thread;
+
+    pthread_mutex_t mu;
+    pthread_cond_t cv;       /* writer thread: blocks queued or closing */
+    pthread_cond_t space_cv; /* producers: queue below MANIFEST_MAX_QUEUED */
+    ManifestBlock *head;
+    ManifestBlock *tail;
+    size_t queued;
+    ManifestBlock *free_list;
+    int closing;
+    int err; /* errno of the first failed write, 0 otherwise */
+
+    atomic_uint_fast64_t next_id;
+};
+
+static int write_all(int fd, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        ssize_t wr = write(fd, p, n);
+        if (wr < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += (size_t)wr;
+        n -= (size_t)wr;
+    }
+    return 0;
+}
+
+static void *writer_main(void *arg) {
+    ManifestWriter *w = (ManifestWriter *)arg;
+
+    pthread_mutex_lock(&w->mu);
+    for (;;) {
+        while (!w->head && !w->closing) pthread_cond_wait(&w->cv, &w->mu);
+        if (!w->head) break;
+
+        ManifestBlock *b = w->head;
+        w->head = b->next;
+        if (!w->head) w->tail = NULL;
+        int failed = w->err;
+        pthread_mutex_unlock(&w->mu);
+
+        int werr = 0;
+        if (!failed && write_all(w->fd, b->data, b->len) != 0) werr = errno;
+
+        pthread_mutex_lock(&w->mu);
+        if (werr && !w->err) w->err = werr;
+        b->next = w->free_list;
+        w->free_list = b;
+        w->queued--;
+        pthread_cond_broadcast(&w->space_cv);
+    }
+    pthread_mutex_unlock(&w->mu);
+    return NULL;
+}
+
+ManifestWriter *manifest_writer_open(const char *path, const DuAllocator *a) {
+    ManifestWriter *w = (ManifestWriter *)du_calloc(a, 1, sizeof(ManifestWriter));
+    if (!w) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (a) w->alloc = *a;
+    atomic_init(&w->next_id, 1);
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        int err = errno;
+        du_free(a, w);
+        errno = err;
+        return NULL;
+    }
+
+    unsigned char hdr[MANIFEST_HEADER_SIZE];
+    uint32_t version = MANIFEST_VERSION;
+    uint32_t flags = 0;
+    memcpy(hdr, MANIFEST_MAGIC, 8);
+    memcpy(hdr + 8, &version, 4);
+    memcpy(hdr + 12, &flags, 4);
+    if (write_all(w->fd, hdr, sizeof(hdr)) != 0) {
+        int err = errno;
+        close(w->fd);
+        du_free(a, w);
+        errno = err;
+        return NULL;
+    }
+
+    pthread_mutex_init(&w->mu, NULL);
+    pthread_cond_init(&w->cv, NULL);
+    pthread_cond_init(&w->space_cv, NULL);
+    int prc = pthread_create(&w->thread, NULL, writer_main, w);
+    if (prc != 0) {
+        pthread_cond_destroy(&w->space_cv);
+        pthread_cond_destroy(&w->cv);
+        pthread_mutex_destroy(&w->mu);
+        close(w->fd);
+        du_free(a, w);
+        errno = prc;
+        return NULL;
+    }
+    return w;
+}
+
+int manifest_writer_close(ManifestWriter *w) {
+    if (!w) return 0;
+
+    pthread_mutex_lock(&w->mu);
+    w->closing = 1;
+    pthread_cond_signal(&w->cv);
+    pthread_mutex_unlock(&w->mu);
+    pthread_join(w->thread, NULL);
+
+    int err = w->err;
+    if (close(w->fd) != 0 && !err) err = errno;
+
+    ManifestBlock *b = w->free_list;
+    while (b) {
+        ManifestBlock *n = b->next;
+        du_free(&w->alloc, b);
+        b = n;
+    }
+
+    pthread_cond_destroy(&w->space_cv);
+    pthread_cond_destroy(&w->cv);
+    pthread_mutex_destroy(&w->mu);
+
+    DuAllocator a = w->alloc;
+    du_free(&a, w);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t manifest_new_dir_id(ManifestWriter *w) {
+    return (uint64_t)atomic_fetch_add_explicit(&w->next_id, 1, memory_order_relaxed);
+}
+
+void manifest_flush(ManifestWriter *w, ManifestBlock **cur) {
+    ManifestBlock *b = *cur;
+    if (!b) return;
+    *cur = NULL;
+
+    pthread_mutex_lock(&w->mu);
+    if (b->len == 0) {
+        b->next = w->free_list;
+        w->free_list = b;
+        pthread_mutex_unlock(&w->mu);
+        return;
+    }
+    while (w->queued >= MANIFEST_MAX_QUEUED) pthread_cond_wait(&w->space_cv, &w->mu);
+    b->next = NULL;
+    if (w->tail) w->tail->next = b;
+    else w->head = b;
+    w->tail = b;
+    w->queued++;
+    pthread_cond_signal(&w->cv);
+    pthread_mutex_unlock(&w->mu);
+}
+
+static ManifestBlock *block_get(ManifestWriter *w) {
+    pthread_mutex_lock(&w->mu);
+    ManifestBlock *b = w->free_list;
+    if (b) w->free_list = b->next;
+    pthread_mutex_unlock(&w->mu);
+
+    if (!b) b = (ManifestBlock *)du_malloc(&w->alloc, sizeof(ManifestBlock));
+    if (!b) return NULL;
+    b->next = NULL;
+    b->len = 0;
+    return b;
+}
+
+static unsigned char *put_u64(unsigned char *p, uint64_t v) {
+    memcpy(p, &v, 8);
+    return p + 8;
+}
+
+int manifest_append(ManifestWriter *w, ManifestBlock **cur, const ManifestRecord *r) {
+    size_t name_len = (r->name_len > UINT16_MAX) ? UINT16_MAX : r->name_len;
+    size_t need = MANIFEST_RECORD_FIXED + name_len;
+
+    if (*cur && (*cur)->len + need > MANIFEST_BLOCK_SIZE) manifest_flush(w, cur);
+    if (!*cur) {
+        *cur = block_get(w);
+        if (!*cur) return -1;
+    }
+
+    unsigned char *p = (*cur)->data + (*cur)->len;
+    uint16_t nl = (uint16_t)name_len;
+    p[0] = r->type;
+    p[1] = r->flags;
+    memcpy(p + 2, &nl, 2);
+    p = put_u64(p + 4, r->id);
+    p = put_u64(p, r->parent);
+    p = put_u64(p, r->size);
+    p = put_u64(p, r->dev);
+    p = put_u64(p, r->ino);
+    p = put_u64(p, (uint64_t)r->mtime);
+    memcpy(p, r->name, name_len);
+
+    (*cur)->len += need;
+    return 0;
+}
+
+/* ---------------- Reader / diff ---------------- */
+
+typedef struct MappedManifest {
+    const char *path;
+    const unsigned char *data;
+    size_t size;
+
+    uint64_t max_id;
+    uint64_t *parent;           /* by dir id */
+    uint64_t *bytes;            /* by dir id: own, then recursive */
+    uint64_t *entries;          /* by dir id: records directly inside, then recursive */
+    uint64_t *stamp;            /* by dir id: last multi-link inode added */
+    const unsigned char **name; /* by dir id, into the mapping */
+    uint16_t *name_len;
+    unsigned char *present;
+} MappedManifest;
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static void mf_close(MappedManifest *m) {
+    if (m->data && m->size) munmap((void *)m->data, m->size);
+    free(m->parent);
+    free(m->bytes);
+    free(m->entries);
+    free(m->stamp);
+    free(m->name);
+    free(m->name_len);
+    free(m->present);
+}
+
+/* A file record with st_nlink > 1. */
+typedef struct LinkRef {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t dir;
+} LinkRef;
+
+static int link_cmp(const void *pa, const void *pb) {
+    const LinkRef *a = (const LinkRef *)pa;
+    const LinkRef *b = (const LinkRef *)pb;
+    if (a->dev != b->dev) return (a->dev < b->dev) ? -1 : 1;
+    if (a->ino != b->ino) return (a->ino < b->ino) ? -1 : 1;
+    return 0;
+}
+
+/* Adds each multi-link inode once to every directory on the union of its links' ancestor chains. */
+static int mf_add_links(MappedManifest *m, LinkRef *links, size_t n) {
+    if (n == 0) return 0;
+    m->stamp = (uint64_t *)calloc((size_t)m->max_id + 1, sizeof(uint64_t));
+    if (!m->stamp) return 1;
+
+    qsort(links, n, sizeof(LinkRef), link_cmp);
+
+    uint64_t group = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i == 0 || link_cmp(&links[i - 1], &links[i]) != 0) group++;
+        for (uint64_t d = links[i].dir; d && m->present[d] && m->stamp[d] != group; d = m->parent[d]) {
+            m->stamp[d] = group;
+            m->bytes[d] += links[i].size;
+        }
+    }
+    return 0;
+}
+
+static int mf_invalid(const MappedManifest *m, const char *why) {
+    fprintf(stderr, "du-sync: %s: not a valid manifest: %s\n", m->path, why);
+    return 2;
+}
+
+/* Maps and indexes one manifest. Returns 0, 1 on OOM/I/O error, 2 if invalid. */
+static int mf_load(MappedManifest *m, const char *path) {
+    memset(m, 0, sizeof(*m));
+    m->path = path;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "du-sync: cannot open manifest: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        fprintf(stderr, "du-sync: cannot stat manifest: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    if ((size_t)sb.st_size < MANIFEST_HEADER_SIZE) {
+        close(fd);
+        return mf_invalid(m, "too short");
+    }
+
+    m->size = (size_t)sb.st_size;
+    void *p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "du-sync: cannot map manifest: %s: %s\n", path, strerror(errno));
+        m->size = 0;
+        return 1;
+    }
+    m->data = (const unsigned char *)p;
+    posix_madvise(p, m->size, POSIX_MADV_SEQUENTIAL);
+
+    uint32_t version;
+    memcpy(&version, m->data + 8, 4);
+    if (memcmp(m->data, MANIFEST_MAGIC, 8) != 0 || version != MANIFEST_VERSION) return mf_invalid(m, "bad header");
+
+    /* Pass 1: validate record bounds, find the largest dir id, count multi-link files. */
+    size_t nlinks = 0;
+    for (size_t off = MANIFEST_HEADER_SIZE; off < m->size;) {
+        if (m->size - off < MANIFEST_RECORD_FIXED) return mf_invalid(m, "truncated record");
+        uint16_t nl;
+        memcpy(&nl, m->data + off + 2, 2);
+        if (m->size - off - MANIFEST_RECORD_FIXED < nl) return mf_invalid(m, "truncated name");
+
+        uint64_t id = get_u64(m->data + off + 4);
+        if (id > m->max_id) m->max_id = id;
+        if (m->data[off] == MANIFEST_FILE && (m->data[off + 1] & MANIFEST_MULTI_LINK)) nlinks++;
+        off += MANIFEST_RECORD_FIXED + nl;
+    }
+    if (m->max_id >= SIZE_MAX / sizeof(uint64_t)) return mf_invalid(m, "dir id out of range");
+
+    size_t n = (size_t)m->max_id + 1;
+    m->parent = (uint64_t *)calloc(n, sizeof(uint64_t));
+    m->bytes = (uint64_t *)calloc(n, sizeof(uint64_t));
+    m->entries = (uint64_t *)calloc(n, sizeof(uint64_t));
+    m->name = (const unsigned char **)calloc(n, sizeof(*m->name));
+    m->name_len = (uint16_t *)calloc(n, sizeof(uint16_t));
+    m->present = (unsigned char *)calloc(n, 1);
+    LinkRef *links = (LinkRef *)malloc((nlinks ? nlinks : 1) * sizeof(LinkRef));
+    if (!m->parent || !m->bytes || !m->entries || !m->name || !m->name_len || !m->present || !links) {
+        free(links);
+        return 1;
+    }
+
+    /* Pass 2: index directories, sum single-link file bytes into their directory. */
+    nlinks = 0;
+    for (size_t off = MANIFEST_HEADER_SIZE; off < m->size;) {
+        const unsigned char *r = m->data + off;
+        uint16_t nl;
+        memcpy(&nl, r + 2, 2);
+        uint64_t id = get_u64(r + 4);
+
+        if (r[0] == MANIFEST_DIR && id != 0) {
+            uint64_t parent = get_u64(r + 12);
+            if (parent >= id) {
+                free(links);
+                return mf_invalid(m, "parent id not below dir id");
+            }
+            m->present[id] = 1;
+            m->parent[id] = parent;
+            if (parent) m->entries[parent]++;
+            m->name[id] = r + MANIFEST_RECORD_FIXED;
+            m->name_len[id] = nl;
+        } else if (r[0] == MANIFEST_FILE && id != 0) {
+            uint64_t size = get_u64(r + 20);
+            m->entries[id]++;
+            if (r[1] & MANIFEST_MULTI_LINK) {
+                LinkRef *l = &links[nlinks++];
+                l->dev = get_u64(r + 28);
+                l->ino = get_u64(r + 36);
+                l->size = size;
+                l->dir = id;
+            } else {
+                m->bytes[id] += size;
+            }
+        }
+        off += MANIFEST_RECORD_FIXED + nl;
+    }
+
+    /* Children have larger ids than their parent: one descending pass makes totals recursive. */
+    for (uint64_t id = m->max_id; id > 0; id--) {
+        if (!m->present[id] || !m->parent[id]) continue;
+        m->bytes[m->parent[id]] += m->bytes[id];
+        m->entries[m->parent[id]] += m->entries[id];
+    }
+
+    int rc = mf_add_links(m, links, nlinks);
+    free(links);
+    return rc;
+}
+
+/* (parent id, name) -> dir id, for matching directories of one manifest by path. */
+typedef struct DirIndex {
+    uint64_t *slots; /* dir ids, 0 = empty */
+    size_t mask;
+} DirIndex;
+
+static uint64_t dir_key_hash(uint64_t parent, const unsigned char *name, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ (parent * 0x9e3779b97f4a7c15ULL);
+    for (size_t i = 0; i < len; i++) {
+        h ^= name[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+static int dir_index_build(DirIndex *ix, const MappedManifest *m) {
+    size_t cap = 16;
+    while (cap < ((size_t)m->max_id + 1) * 2) cap *= 2;
+
+    ix->slots = (uint64_t *)calloc(cap, sizeof(uint64_t));
+    if (!ix->slots) return -1;
+    ix->mask = cap - 1;
+
+    for (uint64_t id = 1; id <= m->max_id; id++) {
+        if (!m->present[id]) continue;
+        size_t i = (size_t)dir_key_hash(m->parent[id], m->name[id], m->name_len[id]) & ix->mask;
+        while (ix->slots[i]) i = (i + 1) & ix->mask;
+        ix->slots[i] = id;
+    }
+    return 0;
+}
+
+static uint64_t dir_index_find(const DirIndex *ix, const MappedManifest *m, uint64_t parent, const unsigned char *name,
+                               size_t len) {
+    size_t i = (size_t)dir_key_hash(parent, name, len) & ix->mask;
+    for (uint64_t id = ix->slots[i]; id; id = ix->slots[i]) {
+        if (m->parent[id] == parent && m->name_len[id] == len && memcmp(m->name[id], name, len) == 0) return id;
+        i = (i + 1) & ix->mask;
+    }
+    return 0;
+}
+
+struct ManifestSizes {
+    MappedManifest m;
+    DirIndex ix;
+};
+
+ManifestSizes *manifest_sizes_open(const char *path) {
+    ManifestSizes *h = (ManifestSizes *)calloc(1, sizeof(ManifestSizes));
+    if (!h) return NULL;
+    if (mf_load(&h->m, path) != 0 || dir_index_build(&h->ix, &h->m) != 0) {
+        manifest_sizes_close(h);
+        return NULL;
+    }
+    return h;
+}
+
+void manifest_sizes_close(ManifestSizes *h) {
+    if (!h) return;
+    free(h->ix.slots);
+    mf_close(&h->m);
+    free(h);
+}
+
+uint64_t manifest_sizes_find(const ManifestSizes *h, uint64_t parent, const char *name, size_t len) {
+    if (parent > h->m.max_id || len > UINT16_MAX) return 0;
+    return dir_index_find(&h->ix, &h->m, parent, (const unsigned char *)name, len);
+}
+
+uint64_t manifest_sizes_entries(const ManifestSizes *h, uint64_t id) {
+    return (id && id <= h->m.max_id) ? h->m.entries[id] : 0;
+}
+
+uint64_t manifest_sizes_bytes(const ManifestSizes *h, uint64_t id) {
+    return (id && id <= h->m.max_id) ? h->m.bytes[id] : 0;
+}
+
+static void print_dir_path(FILE *out, const MappedManifest *m, uint64_t id) {
+    /* Walk up to the root, then print names top-down. */
+    uint64_t chain[256];
+    size_t depth = 0;
+    uint64_t cur = id;
+    while (cur && depth < sizeof(chain) / sizeof(chain[0])) {
+        chain[depth++] = cur;
+        cur = m->parent[cur];
+    }
+    if (cur) {
+        print_dir_path(out, m, cur);
+        fputc('/', out);
+    }
+
+    for (size_t i = depth; i-- > 0;) {
+        uint64_t d = chain[i];
+        fwrite(m->name[d], 1, m->name_len[d], out);
+        int trailing_slash = m->name_len[d] > 0 && m->name[d][m->name_len[d] - 1] == '/';
+        if (i > 0 && !trailing_slash) fputc('/', out);
+    }
+}
+
+static void print_delta(FILE *out, uint64_t a, uint64_t b) {
+    int64_t delta = (int64_t)(b - a);
+    fprintf(out, "%+" PRId64 "\t%" PRIu64 "\t%" PRIu64 "\t", delta, a, b);
+}
+
+int manifest_diff(const char *path_a, const char *path_b, FILE *out) {
+    MappedManifest a;
+    MappedManifest b;
+    DirIndex ix = {NULL, 0};
+    uint64_t *match = NULL;    /* by B id: matching A id */
+    unsigned char *seen = NULL; /* by A id: matched by some B dir */
+
+    int rc = mf_load(&a, path_a);
+    if (rc == 0) rc = mf_load(&b, path_b);
+    else memset(&b, 0, sizeof(b));
+    if (rc != 0) goto out;
+
+    match = (uint64_t *)calloc((size_t)b.max_id + 1, sizeof(uint64_t));
+    seen = (unsigned char *)calloc((size_t)a.max_id + 1, 1);
+    if (!match || !seen || dir_index_build(&ix, &a) != 0) {
+        rc = 1;
+        goto out;
+    }
+
+    /* Parents precede children in id order, so each B dir is matched via its parent's match. */
+    for (uint64_t id = 1; id <= b.max_id; id++) {
+        if (!b.present[id]) continue;
+        uint64_t pb = b.parent[id];
+        if (pb && !match[pb]) continue;
+
+        uint64_t ida = dir_index_find(&ix, &a, pb ? match[pb] : 0, b.name[id], b.name_len[id]);
+        match[id] = ida;
+        if (ida) seen[ida] = 1;
+    }
+
+    for (uint64_t id = 1; id <= b.max_id; id++) {
+        if (!b.present[id]) continue;
+        uint64_t bytes_a = match[id] ? a.bytes[match[id]] : 0;
+        if (bytes_a == b.bytes[id] && match[id]) continue;
+        print_delta(out, bytes_a, b.bytes[id]);
+        print_dir_path(out, &b, id);
+        fputc('\n', out);
+    }
+    for (uint64_t id = 1; id <= a.max_id; id++) {
+        if (!a.present[id] || seen[id]) continue;
+        print_delta(out, a.bytes[id], 0);
+        print_dir_path(out, &a, id);
+        fputc('\n', out);
+    }
+
+    if (fflush(out) != 0) rc = 1;
+
+out:
+    free(ix.slots);
+    free(match);
+    free(seen);
+    mf_close(&a);
+    mf_close(&b);
+    return rc;
+}
@@ -0,0 +1,92 @@
+#include "out_buf.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void write_all(OutBuf *b, const char *p, size_t n) {
+    while (n > 0 && !b->err) {
+        ssize_t w = write(b->fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            b->err = errno;
+            break;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+int out_buf_init(OutBuf *b, int fd, size_t cap) {
+    b->fd = fd;
+    b->len = 0;
+    b->cap = cap;
+    b->err = 0;
+    b->interactive = isatty(fd);
+    b->buf = (char *)malloc(cap);
+    return b->buf ? 0 : -1;
+}
+
+void out_buf_flush(OutBuf *b) {
+    write_all(b, b->buf, b->len);
+    b->len = 0;
+}
+
+int out_buf_destroy(OutBuf *b) {
+    out_buf_flush(b);
+    free(b->buf);
+    b->buf = NULL;
+    if (!b->err) return 0;
+    errno = b->err;
+    return -1;
+}
+
+void out_buf_write(OutBuf *b, const char *p, size_t n) {
+    if (b->len + n > b->cap) out_buf_flush(b);
+    if (n > b->cap) {
+        write_all(b, p, n);
+        return;
+    }
+    memcpy(b->buf + b->len, p, n);
+    b->len += n;
+}
+
+void out_buf_printf(OutBuf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b->buf + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+
+    if ((size_t)n < b->cap - b->len) {
+        b->len += (size_t)n;
+        return;
+    }
+
+    out_buf_flush(b);
+    if ((size_t)n < b->cap) {
+        va_start(ap, fmt);
+        vsnprintf(b->buf, b->cap, fmt, ap);
+        va_end(ap);
+        b->len = (size_t)n;
+        return;
+    }
+
+    char *big = (char *)malloc((size_t)n + 1);
+    if (!big) {
+        b->err = ENOMEM;
+        return;
+    }
+    va_start(ap, fmt);
+    vsnprintf(big, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    write_all(b, big, (size_t)n);
+    free(big);
+}
+
+void out_buf_end_record(OutBuf *b) {
+    if (b->interactive) out_buf_flush(b);
+}
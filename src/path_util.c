@@ -4,15 +4,19 @@
 #include <string.h>
 #include <unistd.h>
 
-char *xstrdup(const char *s) {
+char *xstrdup_with(const DuAllocator *a, const char *s) {
     size_t n = strlen(s) + 1;
-    char *p = (char *)malloc(n);
+    char *p = (char *)du_malloc(a, n);
     if (!p) return NULL;
     memcpy(p, s, n);
     return p;
 }
 
-char *path_join(const char *base, const char *name) {
+char *xstrdup(const char *s) {
+    return xstrdup_with(NULL, s);
+}
+
+char *path_join_with(const DuAllocator *a, const char *base, const char *name) {
     size_t bl = strlen(base);
     size_t nl = strlen(name);
 
@@ -20,7 +24,7 @@ char *path_join(const char *base, const char *name) {
     if (bl > 0 && base[bl - 1] == '/') need_slash = 0;
 
     size_t out_len = bl + (size_t)need_slash + nl + 1;
-    char *out = (char *)malloc(out_len);
+    char *out = (char *)du_malloc(a, out_len);
     if (!out) return NULL;
 
     memcpy(out, base, bl);
@@ -31,6 +35,10 @@ char *path_join(const char *base, const char *name) {
     return out;
 }
 
+char *path_join(const char *base, const char *name) {
+    return path_join_with(NULL, base, name);
+}
+
 int stdin_is_tty(void) {
     return isatty(STDIN_FILENO) ? 1 : 0;
 }
@@ -0,0 +1,135 @@
+#include "progress.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct ProgressReporter {
+    const DuScan *scan;
+    double interval;
+    const char *status_path; /* NULL: stderr */
+    atomic_int stop;
+    pthread_t thread;
+
+    double start;
+    double last_t;
+    DuProgress last;
+};
+
+static double mono_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double rate(uint64_t now, uint64_t before, double dt) {
+    return (dt > 0.0 && now >= before) ? (double)(now - before) / dt : 0.0;
+}
+
+static void write_status(const char *path, const char *line, size_t len) {
+    size_t n = strlen(path) + 5;
+    char *tmp = (char *)malloc(n);
+    if (!tmp) return;
+    snprintf(tmp, n, "%s.tmp", path);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ssize_t w = write(fd, line, len);
+        int ok = (w == (ssize_t)len);
+        if (close(fd) != 0) ok = 0;
+        if (ok) rename(tmp, path);
+        else unlink(tmp);
+    }
+    free(tmp);
+}
+
+static void report(ProgressReporter *r) {
+    DuProgress p;
+    du_scan_progress(r->scan, &p);
+    double t = mono_seconds();
+    double dt = t - r->last_t;
+
+    char line[256];
+    int n = snprintf(line, sizeof(line),
+                     "du-sync: progress: %" PRIu64 " dirs, %" PRIu64 " files, %" PRIu64 " bytes, %" PRIu64
+                     " queued (peak %" PRIu64 "); %.0f dirs/s, %.0f files/s, %.1f MB/s; %.1fs\n",
+                     p.dirs, p.files, p.bytes, p.queued, p.peak_queued, rate(p.dirs, r->last.dirs, dt),
+                     rate(p.files, r->last.files, dt), rate(p.bytes, r->last.bytes, dt) / 1e6, t - r->start);
+    if (n < 0) return;
+    size_t len = ((size_t)n < sizeof(line)) ? (size_t)n : sizeof(line) - 1;
+
+    if (r->status_path) write_status(r->status_path, line, len);
+    else fputs(line, stderr);
+
+    r->last = p;
+    r->last_t = t;
+}
+
+static void *reporter_main(void *arg) {
+    ProgressReporter *r = (ProgressReporter *)arg;
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    for (;;) {
+        int sig;
+        if (r->interval > 0.0) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)r->interval;
+            ts.tv_nsec = (long)((r->interval - (double)ts.tv_sec) * 1e9);
+            sig = sigtimedwait(&set, NULL, &ts);
+        } else {
+            sig = sigwaitinfo(&set, NULL);
+        }
+
+        if (atomic_load(&r->stop)) break;
+        if (sig < 0 && errno == EINTR) continue;
+        report(r); /* SIGUSR1 or interval elapsed (EAGAIN) */
+    }
+    return NULL;
+}
+
+int progress_block_signal(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    return (pthread_sigmask(SIG_BLOCK, &set, NULL) == 0) ? 0 : -1;
+}
+
+ProgressReporter *progress_start(const DuScan *scan, double interval, const char *status_path) {
+    ProgressReporter *r = (ProgressReporter *)calloc(1, sizeof(ProgressReporter));
+    if (!r) return NULL;
+
+    r->scan = scan;
+    r->interval = interval;
+    r->status_path = status_path;
+    atomic_init(&r->stop, 0);
+    r->start = r->last_t = mono_seconds();
+
+    int err = pthread_create(&r->thread, NULL, reporter_main, r);
+    if (err != 0) {
+        free(r);
+        errno = err;
+        return NULL;
+    }
+    return r;
+}
+
+void progress_stop(ProgressReporter *r) {
+    if (!r) return;
+    atomic_store(&r->stop, 1);
+    pthread_kill(r->thread, SIGUSR1);
+    pthread_join(r->thread, NULL);
+
+    if (r->status_path) report(r);
+    free(r);
+}
@@ -0,0 +1,365 @@
+#include "shard.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHARD_MAGIC "DUSYNCS1"
+#define SHARD_VERSION 1u
+#define SHARD_HEADER_SIZE 40u
+#define SHARD_ROOT_FIXED 32u
+#define SHARD_LINK_SIZE 24u
+
+typedef struct ShardLink {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+} ShardLink;
+
+static int link_cmp(const void *pa, const void *pb) {
+    const ShardLink *a = (const ShardLink *)pa;
+    const ShardLink *b = (const ShardLink *)pb;
+    if (a->dev != b->dev) return (a->dev < b->dev) ? -1 : 1;
+    if (a->ino != b->ino) return (a->ino < b->ino) ? -1 : 1;
+    return 0;
+}
+
+/* ---------------- Writer ---------------- */
+
+/* Links of one root, collected until its result is delivered. */
+typedef struct RootLinks {
+    ShardLink *links;
+    size_t len;
+    size_t cap;
+    uint64_t bytes;
+} RootLinks;
+
+struct ShardFile {
+    FILE *f;
+    int err; /* errno of the first failure, 0 otherwise */
+
+    pthread_mutex_t mu; /* guards roots */
+    size_t nroots;
+    RootLinks *roots;
+};
+
+static void put(ShardFile *f, const void *p, size_t n) {
+    if (f->err || n == 0) return;
+    if (fwrite(p, 1, n, f->f) != n) f->err = errno ? errno : EIO;
+}
+
+static void put_u32(ShardFile *f, uint32_t v) {
+    put(f, &v, sizeof(v));
+}
+
+static void put_u64(ShardFile *f, uint64_t v) {
+    put(f, &v, sizeof(v));
+}
+
+ShardFile *shard_file_create(const char *path, unsigned index, unsigned count, unsigned level, uint64_t nroots) {
+    ShardFile *f = (ShardFile *)calloc(1, sizeof(ShardFile));
+    if (!f) return NULL;
+    f->nroots = (size_t)nroots;
+    f->roots = (RootLinks *)calloc(f->nroots ? f->nroots : 1, sizeof(RootLinks));
+    if (f->roots) f->f = fopen(path, "w");
+    if (!f->f) {
+        int err = f->roots ? errno : ENOMEM;
+        free(f->roots);
+        free(f);
+        errno = err;
+        return NULL;
+    }
+    pthread_mutex_init(&f->mu, NULL);
+
+    put(f, SHARD_MAGIC, 8);
+    put_u32(f, SHARD_VERSION);
+    put_u32(f, 0);
+    put_u32(f, (uint32_t)index);
+    put_u32(f, (uint32_t)count);
+    put_u32(f, (uint32_t)level);
+    put_u32(f, 0);
+    put_u64(f, nroots);
+    return f;
+}
+
+int shard_file_note_entry(void *user, const DuEntry *e) {
+    ShardFile *f = (ShardFile *)user;
+    if (e->kind != DU_ENTRY_FILE || !e->counted || e->st->st_nlink <= 1) return 0;
+    if (e->root >= f->nroots) return 1;
+
+    ShardLink l = {.dev = (uint64_t)e->st->st_dev, .ino = (uint64_t)e->st->st_ino, .size = (uint64_t)e->st->st_size};
+    int rc = 0;
+    pthread_mutex_lock(&f->mu);
+    RootLinks *r = &f->roots[e->root];
+    if (r->len == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 256;
+        ShardLink *links = (ShardLink *)realloc(r->links, cap * sizeof(ShardLink));
+        if (links) {
+            r->links = links;
+            r->cap = cap;
+        }
+    }
+    if (r->len < r->cap) {
+        r->links[r->len++] = l;
+        r->bytes += l.size;
+    } else {
+        rc = DU_ENTRY_NOMEM;
+    }
+    pthread_mutex_unlock(&f->mu);
+    return rc;
+}
+
+void shard_file_add_root(ShardFile *f, const DuRootResult *r) {
+    if (r->index >= f->nroots) {
+        if (!f->err) f->err = EINVAL;
+        return;
+    }
+    pthread_mutex_lock(&f->mu);
+    RootLinks *l = &f->roots[r->index];
+    if (r->status != 0) l->len = 0;
+    uint64_t bytes = (r->status == 0) ? r->bytes - l->bytes : 0;
+
+    int32_t st = (int32_t)r->status;
+    uint32_t len = (uint32_t)strlen(r->path);
+    put(f, &st, sizeof(st));
+    put_u32(f, len);
+    put_u64(f, (uint64_t)r->index);
+    put_u64(f, bytes);
+    put_u64(f, (uint64_t)l->len);
+    put(f, r->path, len);
+    put(f, l->links, l->len * sizeof(ShardLink));
+
+    free(l->links);
+    memset(l, 0, sizeof(*l));
+    pthread_mutex_unlock(&f->mu);
+}
+
+int shard_file_close(ShardFile *f) {
+    if (fclose(f->f) != 0 && !f->err) f->err = errno;
+    pthread_mutex_destroy(&f->mu);
+    int err = f->err;
+    for (size_t i = 0; i < f->nroots; i++) free(f->roots[i].links);
+    free(f->roots);
+    free(f);
+    if (!err) return 0;
+    errno = err;
+    return -1;
+}
+
+/* ---------------- Merge ---------------- */
+
+typedef struct MappedShard {
+    const char *path;
+    const unsigned char *data;
+    size_t size;
+    uint32_t index;
+    uint32_t count;
+    uint32_t level;
+    size_t nroots;
+    size_t *roots; /* section offsets, by root index */
+} MappedShard;
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static int shard_invalid(const MappedShard *m, const char *why) {
+    fprintf(stderr, "du-sync: %s: not a valid shard file: %s\n", m->path, why);
+    return 2;
+}
+
+/* Maps and indexes one shard file. Returns 0, 1 on OOM/I/O error, 2 if invalid. */
+static int shard_load(MappedShard *m, const char *path) {
+    memset(m, 0, sizeof(*m));
+    m->path = path;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "du-sync: cannot open shard file: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        fprintf(stderr, "du-sync: cannot stat shard file: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    if ((size_t)sb.st_size < SHARD_HEADER_SIZE) {
+        close(fd);
+        return shard_invalid(m, "too short");
+    }
+
+    m->size = (size_t)sb.st_size;
+    void *p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "du-sync: cannot map shard file: %s: %s\n", path, strerror(errno));
+        m->size = 0;
+        return 1;
+    }
+    m->data = (const unsigned char *)p;
+
+    if (memcmp(m->data, SHARD_MAGIC, 8) != 0) return shard_invalid(m, "bad magic");
+    if (get_u32(m->data + 8) != SHARD_VERSION) return shard_invalid(m, "unsupported version");
+    m->index = get_u32(m->data + 16);
+    m->count = get_u32(m->data + 20);
+    m->level = get_u32(m->data + 24);
+    if (m->count == 0 || m->index >= m->count || m->level == 0) return shard_invalid(m, "bad shard number");
+    uint64_t nroots = get_u64(m->data + 32);
+    if (nroots > (m->size - SHARD_HEADER_SIZE) / SHARD_ROOT_FIXED) return shard_invalid(m, "bad root count");
+
+    m->nroots = (size_t)nroots;
+    m->roots = (size_t *)calloc(m->nroots ? m->nroots : 1, sizeof(size_t));
+    if (!m->roots) {
+        fprintf(stderr, "du-sync: out of memory\n");
+        return 1;
+    }
+
+    size_t off = SHARD_HEADER_SIZE;
+    for (size_t i = 0; i < m->nroots; i++) {
+        if (m->size - off < SHARD_ROOT_FIXED) return shard_invalid(m, "truncated root");
+        uint32_t len = get_u32(m->data + off + 4);
+        uint64_t index = get_u64(m->data + off + 8);
+        uint64_t nlinks = get_u64(m->data + off + 24);
+        if (index >= m->nroots || m->roots[index] != 0) return shard_invalid(m, "bad root index");
+        m->roots[index] = off;
+        off += SHARD_ROOT_FIXED;
+        if (m->size - off < len) return shard_invalid(m, "truncated root");
+        off += len;
+        if (nlinks > (m->size - off) / SHARD_LINK_SIZE) return shard_invalid(m, "truncated links");
+        off += (size_t)nlinks * SHARD_LINK_SIZE;
+    }
+    if (off != m->size) return shard_invalid(m, "trailing data");
+    return 0;
+}
+
+static void shard_unload(MappedShard *m) {
+    if (m->data && m->size) munmap((void *)m->data, m->size);
+    free(m->roots);
+}
+
+/*
+ * Checks that the files are one per shard of the same run. Roots are matched by
+ * index, not path, so hosts may mount the tree in different places.
+ * Returns 0, 1 on OOM, 2 if not.
+ */
+static int shard_check_set(const MappedShard *m, size_t n) {
+    const MappedShard *first = &m[0];
+    for (size_t k = 1; k < n; k++) {
+        if (m[k].count != first->count || m[k].level != first->level || m[k].nroots != first->nroots) {
+            fprintf(stderr, "du-sync: %s and %s are not from the same sharded run\n", first->path, m[k].path);
+            return 2;
+        }
+    }
+
+    const char **owner = (const char **)calloc(first->count, sizeof(const char *));
+    if (!owner) {
+        fprintf(stderr, "du-sync: out of memory\n");
+        return 1;
+    }
+    int rc = 0;
+    for (size_t k = 0; k < n && rc == 0; k++) {
+        if (owner[m[k].index]) {
+            fprintf(stderr, "du-sync: %s and %s are both shard %" PRIu32 "/%" PRIu32 "\n", owner[m[k].index],
+                    m[k].path, m[k].index + 1, first->count);
+            rc = 2;
+        }
+        owner[m[k].index] = m[k].path;
+    }
+    for (uint32_t s = 0; s < first->count && rc == 0; s++) {
+        if (!owner[s]) {
+            fprintf(stderr, "du-sync: shard %" PRIu32 "/%" PRIu32 " is missing\n", s + 1, first->count);
+            rc = 2;
+        }
+    }
+    free(owner);
+    return rc;
+}
+
+/* Total of root i over all shards: their own bytes plus each distinct hardlinked inode once. */
+static int shard_merge_root(const MappedShard *m, size_t n, size_t i, ShardLink **buf, size_t *cap,
+                            uint64_t *out_bytes, int *out_status) {
+    uint64_t bytes = 0;
+    size_t total = 0;
+    *out_status = 0;
+    for (size_t k = 0; k < n; k++) {
+        const unsigned char *r = m[k].data + m[k].roots[i];
+        int32_t st;
+        memcpy(&st, r, 4);
+        if (st != 0) *out_status = st;
+        bytes += get_u64(r + 16);
+        total += (size_t)get_u64(r + 24);
+    }
+    if (*out_status != 0) return 0;
+
+    if (total > *cap) {
+        ShardLink *links = (ShardLink *)realloc(*buf, total * sizeof(ShardLink));
+        if (!links) return 1;
+        *buf = links;
+        *cap = total;
+    }
+    size_t len = 0;
+    for (size_t k = 0; k < n; k++) {
+        const unsigned char *r = m[k].data + m[k].roots[i];
+        size_t nlinks = (size_t)get_u64(r + 24);
+        if (nlinks > 0) memcpy(*buf + len, r + SHARD_ROOT_FIXED + get_u32(r + 4), nlinks * sizeof(ShardLink));
+        len += nlinks;
+    }
+
+    qsort(*buf, len, sizeof(ShardLink), link_cmp);
+    for (size_t j = 0; j < len; j++) {
+        if (j == 0 || link_cmp(&(*buf)[j - 1], &(*buf)[j]) != 0) bytes += (*buf)[j].size;
+    }
+    *out_bytes = bytes;
+    return 0;
+}
+
+int shard_merge(const char *const *paths, size_t n, FILE *out) {
+    MappedShard *m = (MappedShard *)calloc(n ? n : 1, sizeof(MappedShard));
+    if (!m) {
+        fprintf(stderr, "du-sync: out of memory\n");
+        return 1;
+    }
+
+    int rc = 0;
+    size_t loaded = 0;
+    for (; loaded < n && rc == 0; loaded++) rc = shard_load(&m[loaded], paths[loaded]);
+    if (rc == 0 && n > 0) rc = shard_check_set(m, n);
+
+    ShardLink *buf = NULL;
+    size_t cap = 0;
+    bool failed = false;
+    for (size_t i = 0; rc == 0 && n > 0 && i < m[0].nroots; i++) {
+        uint64_t bytes = 0;
+        int status = 0;
+        if (shard_merge_root(m, n, i, &buf, &cap, &bytes, &status) != 0) {
+            fprintf(stderr, "du-sync: out of memory\n");
+            rc = 1;
+        } else if (status != 0) {
+            failed = true;
+        } else {
+            const unsigned char *r = m[0].data + m[0].roots[i];
+            fprintf(out, "%" PRIu64 "\t%.*s\n", bytes, (int)get_u32(r + 4), (const char *)r + SHARD_ROOT_FIXED);
+        }
+    }
+    if (rc == 0 && failed) rc = 1;
+
+    free(buf);
+    for (size_t k = 0; k < loaded; k++) shard_unload(&m[k]);
+    free(m);
+    return rc;
+}
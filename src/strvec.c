@@ -3,8 +3,12 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#define STRVEC_READ_BLOCK ((size_t)1 << 20)
+
 static int strvec_grow(StrVec *v, size_t min_cap) {
     size_t new_cap = (v->cap == 0) ? 8 : v->cap;
     while (new_cap < min_cap) new_cap *= 2;
@@ -17,88 +21,179 @@ static int strvec_grow(StrVec *v, size_t min_cap) {
     return 0;
 }
 
+static int strvec_own(StrVec *v, void *p, size_t len, int mapped) {
+    if (v->blocks_len == v->blocks_cap) {
+        size_t new_cap = (v->blocks_cap == 0) ? 8 : v->blocks_cap * 2;
+        StrBlock *b = (StrBlock *)realloc(v->blocks, new_cap * sizeof(StrBlock));
+        if (!b) return -1;
+        v->blocks = b;
+        v->blocks_cap = new_cap;
+    }
+    v->blocks[v->blocks_len].p = p;
+    v->blocks[v->blocks_len].len = len;
+    v->blocks[v->blocks_len].mapped = mapped;
+    v->blocks_len++;
+    return 0;
+}
+
+/* Pushes a string stored in a block already owned by v. */
+static int strvec_push_ref(StrVec *v, char *s) {
+    if (v->len == v->cap) {
+        if (strvec_grow(v, v->len + 1) != 0) return -1;
+    }
+    v->items[v->len++] = s;
+    return 0;
+}
+
 void strvec_init(StrVec *v) {
     v->items = NULL;
     v->len = 0;
     v->cap = 0;
+    v->blocks = NULL;
+    v->blocks_len = 0;
+    v->blocks_cap = 0;
 }
 
 void strvec_destroy(StrVec *v) {
     if (!v) return;
-    for (size_t i = 0; i < v->len; i++) free(v->items[i]);
+    for (size_t i = 0; i < v->blocks_len; i++) {
+        if (v->blocks[i].mapped) munmap(v->blocks[i].p, v->blocks[i].len);
+        else free(v->blocks[i].p);
+    }
+    free(v->blocks);
     free(v->items);
-    v->items = NULL;
-    v->len = 0;
-    v->cap = 0;
+    strvec_init(v);
 }
 
 int strvec_push(StrVec *v, char *s) {
-    if (v->len == v->cap) {
-        if (strvec_grow(v, v->len + 1) != 0) return -1;
+    if (strvec_own(v, s, 0, 0) != 0) return -1;
+    if (strvec_push_ref(v, s) != 0) {
+        v->blocks_len--;
+        return -1;
     }
-    v->items[v->len++] = s;
     return 0;
 }
 
-int strvec_read_from_stdin(StrVec *v, int delim) {
-    const size_t CHUNK = 4096;
-    unsigned char buf[CHUNK];
+/*
+ * Splits buf[*start, end) at delim, terminating each complete entry in place.
+ * On return *start is the beginning of the trailing partial entry.
+ */
+static int split_block(StrVec *v, char *buf, size_t *start, size_t end, int delim) {
+    size_t pos = *start;
+    while (pos < end) {
+        char *hit = (char *)memchr(buf + pos, delim, end - pos);
+        if (!hit) break;
+
+        size_t at = (size_t)(hit - buf);
+        if (at > pos) {
+            *hit = '\0';
+            if (strvec_push_ref(v, buf + pos) != 0) return -1;
+        }
+        pos = at + 1;
+    }
+    *start = pos;
+    return 0;
+}
+
+/* Copies a final unterminated entry into its own allocation. */
+static int push_copy(StrVec *v, const char *s, size_t n) {
+    char *p = (char *)malloc(n + 1);
+    if (!p) return -1;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    if (strvec_push(v, p) != 0) {
+        free(p);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * mmap path for a regular file: a private writable mapping lets the
+ * delimiters be overwritten with NULs without touching the file.
+ * Returns 0 on success, -1 on OOM, 1 if the mapping is not possible.
+ */
+static int read_mapped(StrVec *v, int fd, int delim) {
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)) return 1;
+
+    off_t off = lseek(fd, 0, SEEK_CUR);
+    if (off < 0 || off >= sb.st_size) return 1;
+
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) return 1;
+    off_t map_off = off - off % (off_t)page;
+    size_t map_len = (size_t)(sb.st_size - map_off);
+
+    void *p = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, map_off);
+    if (p == MAP_FAILED) return 1;
+    if (strvec_own(v, p, map_len, 1) != 0) {
+        munmap(p, map_len);
+        return -1;
+    }
+    posix_madvise(p, map_len, POSIX_MADV_SEQUENTIAL);
+
+    /* Consume the input like read() would. */
+    lseek(fd, sb.st_size, SEEK_SET);
+
+    char *buf = (char *)p;
+    size_t start = (size_t)(off - map_off);
+    if (split_block(v, buf, &start, map_len, delim) != 0) return -1;
+    if (start < map_len && push_copy(v, buf + start, map_len - start) != 0) return -1;
+    return 0;
+}
 
-    char *cur = NULL;
-    size_t cur_len = 0;
-    size_t cur_cap = 0;
+int strvec_read_fd(StrVec *v, int fd, int delim) {
+    int mrc = read_mapped(v, fd, delim);
+    if (mrc <= 0) return mrc;
+
+    char *buf = NULL;
+    size_t cap = 0;
+    size_t used = 0;
+    size_t start = 0; /* first byte of the current partial entry */
 
     for (;;) {
-        ssize_t rd = read(STDIN_FILENO, buf, CHUNK);
+        if (used == cap) {
+            /* Block full: move the partial entry into a fresh block; the old one stays owned. */
+            size_t partial = used - start;
+            size_t new_cap = STRVEC_READ_BLOCK;
+            while (new_cap < partial * 2) new_cap *= 2;
+
+            char *nb = (char *)malloc(new_cap);
+            if (!nb) return -1;
+            if (strvec_own(v, nb, new_cap, 0) != 0) {
+                free(nb);
+                return -1;
+            }
+            if (partial) memcpy(nb, buf + start, partial);
+            buf = nb;
+            cap = new_cap;
+            used = partial;
+            start = 0;
+        }
+
+        ssize_t rd = read(fd, buf + used, cap - used);
         if (rd == 0) break;
         if (rd < 0) {
             if (errno == EINTR) continue;
             break;
         }
 
-        for (ssize_t i = 0; i < rd; i++) {
-            unsigned char c = buf[i];
-
-            if ((int)c == delim) {
-                if (cur_len == 0) continue;
-                char *s = (char *)malloc(cur_len + 1);
-                if (!s) goto oom;
-                memcpy(s, cur, cur_len);
-                s[cur_len] = '\0';
-                if (strvec_push(v, s) != 0) {
-                    free(s);
-                    goto oom;
-                }
-                cur_len = 0;
-                continue;
-            }
-
-            if (cur_len + 1 > cur_cap) {
-                size_t new_cap = (cur_cap == 0) ? 128 : cur_cap * 2;
-                char *p = (char *)realloc(cur, new_cap);
-                if (!p) goto oom;
-                cur = p;
-                cur_cap = new_cap;
-            }
-            cur[cur_len++] = (char)c;
-        }
+        size_t end = used + (size_t)rd;
+        if (split_block(v, buf, &start, end, delim) != 0) return -1;
+        used = end;
     }
 
-    if (cur_len > 0) {
-        char *s = (char *)malloc(cur_len + 1);
-        if (!s) goto oom;
-        memcpy(s, cur, cur_len);
-        s[cur_len] = '\0';
-        if (strvec_push(v, s) != 0) {
-            free(s);
-            goto oom;
+    if (start < used) {
+        if (used < cap) {
+            buf[used] = '\0';
+            return strvec_push_ref(v, buf + start);
         }
+        return push_copy(v, buf + start, used - start);
     }
-
-    free(cur);
     return 0;
+}
 
-oom:
-    free(cur);
-    return -1;
+int strvec_read_from_stdin(StrVec *v, int delim) {
+    return strvec_read_fd(v, STDIN_FILENO, delim);
 }
@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp"/t/{1..6}/{1..5}
+for d in "$tmp"/t/*/*; do
+  printf "abc" > "$d/f"
+  printf "defgh" > "$d/g"
+done
+expected="$($BIN "$tmp/t")"
+
+# Idle priority and backoff do not change the result.
+test "$($BIN --background "$tmp/t")" = "$expected"
+test "$($BIN --background -j 4 --slow-stat 0.001 "$tmp/t")" = "$expected"
+
+ms_since() {
+  echo $((($(date +%s%N) - $1) / 1000000))
+}
+
+# 97 stats at 100/s, with 10 of them allowed in a burst, take about 0.9s
+# however many workers share the limit.
+for jobs in 1 4; do
+  start="$(date +%s%N)"
+  test "$($BIN -j "$jobs" --max-stats 100 "$tmp/t")" = "$expected"
+  test "$(ms_since "$start")" -ge 700
+done
+
+# 37 directories at 40/s (a burst of 4) take about 0.8s.
+start="$(date +%s%N)"
+test "$($BIN -j 4 --max-dirs 40 "$tmp/t")" = "$expected"
+test "$(ms_since "$start")" -ge 600
+
+for bad in "--max-stats 0" "--max-dirs -1" "--slow-stat x"; do
+  rc=0; $BIN $bad "$tmp/t" >/dev/null 2>&1 || rc=$?
+  test "$rc" -eq 2
+done
@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+# Enough directories that a scan saving every millisecond can be killed midway;
+# hardlinks span early and late directories, so the saved hardlink set matters.
+mkdir -p "$tmp"/t/{1..60}/{1..60}
+for i in $(seq 1 10); do
+  head -c $((i * 100)) /dev/zero > "$tmp/t/$i/$i/f$i"
+  ln "$tmp/t/$i/$i/f$i" "$tmp/t/60/60/l$i"
+done
+roots=("$tmp/t" "$tmp/t/1" "$tmp/t/60")
+expected="$($BIN "${roots[@]}")"
+test "$expected" = "$(printf '5500\t%s\n100\t%s\n5500\t%s' "${roots[@]}")"
+
+# Kill -9 once a checkpoint exists, then resume with another jobs count. The
+# rate limit keeps each run going for seconds, so the kill lands mid-scan.
+# $1: jobs when saving, $2: jobs when resuming, $3: limit option, rest: roots.
+kill_and_resume() {
+  local save="$1" resume="$2" limit="$3"
+  shift 3
+  local want
+  want="$($BIN "$@")"
+  rm -f "$tmp/ck"
+  $BIN -j "$save" $limit --checkpoint "$tmp/ck" --checkpoint-interval 0.001 "$@" >/dev/null &
+  local pid=$!
+  while [ ! -s "$tmp/ck" ] && kill -0 "$pid" 2>/dev/null; do :; done
+  kill -9 "$pid"
+  wait "$pid" 2>/dev/null || true
+  test -s "$tmp/ck"
+
+  test "$($BIN -j "$resume" --resume "$tmp/ck" --checkpoint "$tmp/ck" "$@" 2>"$tmp/err")" = "$want"
+  test ! -s "$tmp/err"
+  test ! -e "$tmp/ck" # removed after a complete run
+}
+
+for jobs in "1 1" "4 4" "4 1" "1 3"; do
+  kill_and_resume $jobs "--max-dirs 1000" "${roots[@]}"
+done
+
+# File roots saved by a parallel run before they were stat'ed are resumed sequentially.
+mkdir -p "$tmp/many"
+for i in $(seq 1 300); do head -c "$i" /dev/zero > "$tmp/many/$i"; done
+many=("$tmp"/many/*)
+kill_and_resume 4 1 "--max-stats 200" "${many[@]}"
+kill_and_resume 4 4 "--max-stats 200" "${many[@]}"
+
+# A run that completes leaves no checkpoint behind.
+test "$($BIN -j 2 --checkpoint "$tmp/ck" "${roots[@]}")" = "$expected"
+test ! -e "$tmp/ck"
+
+# A sequential run over many roots without subdirectories saves between roots.
+mkdir -p "$tmp/files"
+for i in $(seq 1 2000); do printf 'x' > "$tmp/files/$i"; done
+files=("$tmp"/files/*)
+$BIN -j 1 --debug-threads --checkpoint "$tmp/ck" --checkpoint-interval 0.001 "${files[@]}" 2>"$tmp/log" >/dev/null
+grep -q 'checkpoint path=' "$tmp/log"
+test ! -e "$tmp/ck"
+
+# Checkpoints of other paths and invalid files are rejected.
+$BIN --checkpoint "$tmp/ck" --checkpoint-interval 0.001 "${roots[@]}" >/dev/null &
+pid=$!
+while [ ! -s "$tmp/ck" ] && kill -0 "$pid" 2>/dev/null; do :; done
+kill -9 "$pid" 2>/dev/null || true
+wait "$pid" 2>/dev/null || true
+if [ -s "$tmp/ck" ]; then
+  set +e
+  $BIN --resume "$tmp/ck" "$tmp/t" >/dev/null 2>&1
+  rc=$?
+  set -e
+  test "$rc" -eq 2
+fi
+
+printf 'garbage' > "$tmp/bad"
+if $BIN --resume "$tmp/bad" "$tmp/t" >/dev/null 2>&1; then exit 1; fi
+if $BIN --resume "$tmp/missing" "$tmp/t" >/dev/null 2>&1; then exit 1; fi
+if $BIN --checkpoint "$tmp/ck" --group-by uid "$tmp/t" >/dev/null 2>&1; then exit 1; fi
+if $BIN --checkpoint "$tmp/ck" --checkpoint-interval 0 "$tmp/t" >/dev/null 2>&1; then exit 1; fi
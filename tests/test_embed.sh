@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Links a small program against libdu_sync.a and checks the visitor callbacks
+# and allocator hooks (including group rows) against the CLI result.
+
+CC="${CC:-cc}"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/tree/a/b"
+printf "hello" > "$tmp/tree/a/f1"       # 5
+printf "world!!" > "$tmp/tree/a/b/f2"   # 7
+ln "$tmp/tree/a/f1" "$tmp/tree/link"    # same inode
+
+cat > "$tmp/embed.c" <<'C'
+#include "du_sync.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static atomic_long files, dirs, counted, live_allocs;
+static int stop_with; /* returned for the first file, if set */
+
+static void *my_alloc(void *u, size_t n) { (void)u; atomic_fetch_add(&live_allocs, 1); return malloc(n); }
+static void *my_realloc(void *u, void *p, size_t n) { (void)u; if (!p) atomic_fetch_add(&live_allocs, 1); return realloc(p, n); }
+static void my_free(void *u, void *p) { (void)u; atomic_fetch_sub(&live_allocs, 1); free(p); }
+
+static int on_entry(void *u, const DuEntry *e) {
+    (void)u;
+    if (e->kind == DU_ENTRY_FILE && stop_with) return stop_with;
+    if (e->kind == DU_ENTRY_FILE) atomic_fetch_add(&files, 1);
+    if (e->kind == DU_ENTRY_DIR) atomic_fetch_add(&dirs, 1);
+    if (e->counted) atomic_fetch_add(&counted, 1);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) return 1;
+    if (argc > 3) stop_with = atoi(argv[3]);
+    DuOptions opt = {.jobs = atoi(argv[2]), .group_by = DU_GROUP_UID};
+    DuCallbacks cb = {.on_entry = on_entry};
+    DuAllocator al = {.alloc_fn = my_alloc, .realloc_fn = my_realloc, .free_fn = my_free};
+    DuScan *scan = du_scan_create(&opt, &cb, &al);
+    if (!scan) return 1;
+
+    GroupMap *groups = group_map_create_with(&al);
+    if (!groups) return 1;
+
+    uint64_t bytes = 0;
+    int rc = du_scan_run(scan, argv[1], &bytes, groups);
+    size_t nrows = 0;
+    GroupRow *rows = group_map_rows(groups, &nrows);
+    group_map_rows_free(groups, rows);
+    group_map_destroy(groups);
+    du_scan_destroy(scan);
+    printf("%" PRIu64 " %ld %ld %ld %ld %d %zu\n", bytes, (long)files, (long)dirs, (long)counted, (long)live_allocs,
+           rc, nrows);
+    return rc;
+}
+C
+
+"$CC" -std=c11 -Iinclude -o "$tmp/embed" "$tmp/embed.c" libdu_sync.a -pthread -lm
+
+expected="$(./du-sync "$tmp/tree" | awk '{print $1}')"
+for j in 1 4; do
+  # bytes, files seen, dirs seen, files counted, leaked allocations, rc, uid groups
+  test "$("$tmp/embed" "$tmp/tree" "$j")" = "$expected 3 3 2 0 0 1"
+  # A visitor out of memory fails the scan with 1, any other stop aborts it with 3.
+  test "$("$tmp/embed" "$tmp/tree" "$j" -1 | awk '{print $5, $6}')" = "0 1"
+  test "$("$tmp/embed" "$tmp/tree" "$j" 7 | awk '{print $5, $6}')" = "0 3"
+done
+
+# checkpoint_open reports through on_error and frees through the allocator.
+cat > "$tmp/ckpt.c" <<'C'
+#include "du_sync.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static atomic_long live_allocs;
+static int reported = -1;
+
+static void *my_alloc(void *u, size_t n) { (void)u; atomic_fetch_add(&live_allocs, 1); return malloc(n); }
+static void *my_realloc(void *u, void *p, size_t n) { (void)u; if (!p) atomic_fetch_add(&live_allocs, 1); return realloc(p, n); }
+static void my_free(void *u, void *p) { (void)u; atomic_fetch_sub(&live_allocs, 1); free(p); }
+
+static void on_error(void *u, const char *msg, const char *path, int errnum) {
+    (void)msg;
+    if (strcmp(path, (const char *)u) == 0) reported = errnum;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) return 1;
+    DuCallbacks cb = {.on_error = on_error, .user = argv[1]};
+    DuAllocator al = {.alloc_fn = my_alloc, .realloc_fn = my_realloc, .free_fn = my_free};
+    Checkpoint *c = checkpoint_open(argv[1], &al, &cb);
+    checkpoint_close(c);
+    printf("%d %d %ld\n", c != NULL, reported, (long)live_allocs);
+    return 0;
+}
+C
+
+"$CC" -std=c11 -Iinclude -o "$tmp/ckpt" "$tmp/ckpt.c" libdu_sync.a -pthread -lm
+printf 'DUSYNCK1 but not a checkpoint' > "$tmp/bad"
+test "$("$tmp/ckpt" "$tmp/bad")" = "0 0 0"
+test "$("$tmp/ckpt" "$tmp/missing")" = "0 2 0" # ENOENT
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+for d in a a/x a/y b b/z c; do
+  mkdir -p "$tmp/$d"
+  printf "%s" "$d-data" > "$tmp/$d/f"
+done
+ln "$tmp/a/f" "$tmp/c/hardlink"
+
+# A small tree is read completely by the probes, so the estimate is exact.
+expected="$($BIN "$tmp" | awk '{print $1}')"
+out="$($BIN --estimate=30 "$tmp")"
+
+test "$(echo "$out" | head -n1 | awk '{print $1}')" = "$expected"
+echo "$out" | grep -qx "  $expected	6	exact"
@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/d/sub"
+printf "hello" > "$tmp/d/a"
+printf "abc" > "$tmp/d/b c"
+ln "$tmp/d/a" "$tmp/d/a-link"
+printf "12345678" > "$tmp/d/sub/x"
+ln "$tmp/d/sub/x" "$tmp/x-link"
+
+# Hardlinks count once across the whole list, for their first listed name;
+# a listed directory is traversed with the same set.
+printf '%s\0' "$tmp/d/a" "$tmp/d/b c" "$tmp/d/a-link" "$tmp/x-link" "$tmp/d/sub" > "$tmp/list"
+expected="$(printf '5\t%s\n3\t%s\n0\t%s\n8\t%s\n0\t%s\n16\ttotal' \
+  "$tmp/d/a" "$tmp/d/b c" "$tmp/d/a-link" "$tmp/x-link" "$tmp/d/sub")"
+
+test "$($BIN --files0-from "$tmp/list" -c)" = "$expected"
+test "$($BIN --files0-from - --total < "$tmp/list")" = "$expected"
+test "$($BIN --files0-from "$tmp/list" --total-only)" = "$(printf '16\ttotal')"
+test "$($BIN --files0-from "$tmp/list")" = "$(printf '%s\n' "$expected" | head -n 5)"
+
+# Parallel lstat batches give the same result, in list order.
+for i in $(seq 1 3000); do printf '%s\0' "$tmp/d/a" "$tmp/d/b c"; done > "$tmp/many"
+test "$($BIN --files0-from "$tmp/many" -j 4 | md5sum)" = "$($BIN --files0-from "$tmp/many" | md5sum)"
+test "$($BIN --files0-from "$tmp/many" -j 4 --total-only)" = "$(printf '8\ttotal')"
+
+test "$($BIN --files0-from "$tmp/list" --total-only --group-by ext)" = "$(printf '16\ttotal\n  16\t3\text=')"
+
+# Missing entries warn and count 0; invalid combinations are rejected.
+printf '%s\0' "$tmp/nope" "$tmp/d/a" | $BIN -q --files0-from - -c | grep -q "^5	total$"
+if $BIN --files0-from "$tmp/list" "$tmp/d" >/dev/null 2>&1; then exit 1; fi
+if $BIN -c "$tmp/d" >/dev/null 2>&1; then exit 1; fi
+if $BIN --files0-from "$tmp/does-not-exist" >/dev/null 2>&1; then exit 1; fi
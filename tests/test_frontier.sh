@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+# Wide: many sibling directories. Deep: a chain longer than the inline descent limit.
+for i in $(seq 1 400); do
+  mkdir -p "$tmp/t/wide/d$i/s"
+  printf "ab" > "$tmp/t/wide/d$i/s/f"
+done
+deep="$tmp/t/deep"
+for i in $(seq 1 100); do deep="$deep/x"; done
+mkdir -p "$deep"
+printf "abc" > "$deep/f"
+
+expected="$($BIN "$tmp/t")"
+test "$expected" = "$(printf '803\t%s' "$tmp/t")"
+
+for cap in 1 4 0; do
+  out="$($BIN -j 4 --max-queue "$cap" --debug-threads "$tmp/t" 2>"$tmp/err")"
+  test "$out" = "$expected"
+  peak="$(sed -n 's/.*frontier-peak=\([0-9]*\).*/\1/p' "$tmp/err")"
+  # The cap may be overshot by at most one push per worker.
+  if [ "$cap" -gt 0 ]; then test "$peak" -le $((cap + 4)); fi
+done
+
+if $BIN --max-queue -1 "$tmp/t" >/dev/null 2>&1; then exit 1; fi
@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/a"
+printf "hello" > "$tmp/a/x.txt"        # 5
+ln "$tmp/a/x.txt" "$tmp/a/y.txt"       # same inode, counted once
+printf "abc" > "$tmp/b.c"              # 3
+printf "1234567" > "$tmp/.rc"          # 7, no extension
+touch -d '40 days ago' "$tmp/b.c"
+
+for j in 1 4; do
+  out="$($BIN -j "$j" --group-by ext "$tmp")"
+  test "$(echo "$out" | head -n1 | awk '{print $1}')" = "15"
+  echo "$out" | grep -qx "  5	1	ext=txt"
+  echo "$out" | grep -qx "  3	1	ext=c"
+  echo "$out" | grep -qx "  7	1	ext="
+
+  out="$($BIN -j "$j" --group-by age "$tmp")"
+  echo "$out" | grep -qx "  12	2	age=<1d"
+  echo "$out" | grep -qx "  3	1	age=30d-90d"
+
+  out="$($BIN -j "$j" --group-by uid "$tmp")"
+  echo "$out" | grep -qx "  15	3	uid=$(id -u)"
+done
@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Installs into a staging directory and builds against the installed headers
+# and library only, so a public header that includes a private one fails here.
+
+CC="${CC:-cc}"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+make -s install DESTDIR="$tmp/inst" PREFIX=/usr >/dev/null
+
+cat > "$tmp/use.c" <<'C'
+#include "du_sync.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+    DuOptions opt = {.jobs = 2};
+    DuScan *scan = du_scan_create(&opt, NULL, NULL);
+    if (!scan || argc < 2) return 1;
+
+    uint64_t bytes = 0;
+    int rc = du_scan_run(scan, argv[1], &bytes, NULL);
+    du_scan_destroy(scan);
+    printf("%" PRIu64 "\n", bytes);
+    return rc;
+}
+C
+
+"$CC" -std=c11 -Wall -Werror -I"$tmp/inst/usr/include/du_sync" -o "$tmp/use" "$tmp/use.c" \
+  "$tmp/inst/usr/lib/libdu_sync.a" -pthread -lm
+
+mkdir -p "$tmp/tree/a"
+printf "hello" > "$tmp/tree/a/f"
+test "$("$tmp/use" "$tmp/tree")" = "$(./du-sync "$tmp/tree" | cut -f1)"
@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+r="$tmp/root"
+mkdir -p "$r/a/b" "$r/c" "$r/gone"
+printf "12345" > "$r/a/f"          # 5
+printf "1234567" > "$r/a/b/g"      # 7
+ln "$r/a/f" "$r/c/h"               # counts in both a and c, once in root
+printf "1" > "$r/gone/x"           # 1
+
+$BIN --manifest "$tmp/m1" "$r" >/dev/null
+$BIN -j 4 --manifest "$tmp/m1p" "$r" >/dev/null
+
+# Same tree, different traversal order: no differences.
+test -z "$($BIN diff "$tmp/m1" "$tmp/m1p")"
+
+printf "1234567890" > "$r/c/new"   # +10
+rm -r "$r/gone"                    # -1
+mkdir "$r/n"
+printf "ab" > "$r/n/x"             # +2
+
+$BIN -j 3 --manifest "$tmp/m2" "$r" >/dev/null
+
+expected="$(printf '%s\n' \
+  "+11	13	24	$r" \
+  "+2	0	2	$r/n" \
+  "+10	5	15	$r/c" \
+  "-1	1	0	$r/gone" | sort)"
+got="$($BIN diff "$tmp/m1" "$tmp/m2" | sort)"
+test "$got" = "$expected"
+
+# Not a manifest.
+printf "garbage-garbage-garbage" > "$tmp/bad"
+rc=0
+$BIN diff "$tmp/m1" "$tmp/bad" 2>/dev/null || rc=$?
+test "$rc" = "2"
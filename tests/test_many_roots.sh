@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+# Roots of different sizes; one larger tree so that roots finish out of order.
+mkdir -p "$tmp/big"
+for i in $(seq 1 50); do
+  mkdir -p "$tmp/big/d$i"
+  printf "x" > "$tmp/big/d$i/f"
+done
+for i in $(seq 1 300); do
+  mkdir -p "$tmp/r$i"
+  head -c "$i" /dev/zero > "$tmp/r$i/f"
+done
+ln "$tmp/r1/f" "$tmp/r2/link"   # each root has its own hardlink set
+
+{
+  echo "$tmp/big"
+  for i in $(seq 1 300); do echo "$tmp/r$i"; done
+  echo "$tmp/missing"
+} > "$tmp/list"
+
+expected="$($BIN -q < "$tmp/list")"
+test "$(printf '%s\n' "$expected" | head -n 1)" = "$(printf '50\t%s' "$tmp/big")"
+test "$(printf '%s\n' "$expected" | sed -n 3p)" = "$(printf '3\t%s' "$tmp/r2")"
+test "$(printf '%s\n' "$expected" | wc -l)" = "302"
+
+# Input order is kept with workers and any reorder window.
+for w in 1 7 256; do
+  test "$($BIN -q -j 4 --reorder-window "$w" < "$tmp/list")" = "$expected"
+done
+
+# Completion order: same lines, any order.
+test "$($BIN -q -j 4 --unordered < "$tmp/list" | sort)" = "$(printf '%s\n' "$expected" | sort)"
+
+# Group rows stay attached to their root.
+out="$($BIN -j 3 --group-by ext "$tmp/r5" "$tmp/r6")"
+test "$out" = "$(printf '5\t%s\n  5\t1\text=\n6\t%s\n  6\t1\text=' "$tmp/r5" "$tmp/r6")"
@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/d/sub"
+printf "hello" > "$tmp/d/a"
+printf "abc" > "$tmp/d/sub/b"
+ln "$tmp/d/a" "$tmp/d/sub/a-link"
+
+# Output is unchanged; the status file ends with the final counters in both modes.
+for j in 1 4; do
+  rm -f "$tmp/status"
+  test "$($BIN -j "$j" --progress-file "$tmp/status" "$tmp/d")" = "$(printf '8\t%s' "$tmp/d")"
+  grep -q "^du-sync: progress: 2 dirs, 3 files, 8 bytes, 0 queued (peak [0-9]*);" "$tmp/status"
+  test ! -e "$tmp/status.tmp"
+done
+
+printf '%s\0' "$tmp/d/a" "$tmp/d/sub/a-link" | $BIN --files0-from - -c --progress=0 --progress-file "$tmp/status" >/dev/null
+grep -q "^du-sync: progress: 0 dirs, 2 files, 5 bytes," "$tmp/status"
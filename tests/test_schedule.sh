@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+# Many small directories and one large one, discovered in no particular order.
+for i in $(seq 1 50); do
+  mkdir -p "$tmp/t/s$i"
+  printf "a" > "$tmp/t/s$i/f"
+done
+for i in $(seq 1 20); do
+  mkdir -p "$tmp/t/big/b$i"
+  printf "abcd" > "$tmp/t/big/b$i/f"
+done
+
+expected="$($BIN --manifest "$tmp/hist.bin" "$tmp/t")"
+test "$expected" = "$(printf '130\t%s' "$tmp/t")"
+
+for sched in fifo largest; do
+  test "$($BIN -j 4 --schedule "$sched" "$tmp/t")" = "$expected"
+  test "$($BIN -j 4 --schedule "$sched" --history "$tmp/hist.bin" "$tmp/t")" = "$expected"
+done
+
+# With history the large subtree is read right after the root (an idle worker
+# may take one directory before it is queued).
+$BIN -j 2 --history "$tmp/hist.bin" --debug-threads "$tmp/t" >/dev/null 2>"$tmp/err"
+grep 'pop-dir' "$tmp/err" | sed -n '2,3s/.*path=//p' >"$tmp/first"
+grep -qx "$tmp/t/big" "$tmp/first"
+
+# The history must not be the manifest being written.
+set +e
+$BIN --history "$tmp/hist.bin" --manifest "$tmp/hist.bin" "$tmp/t" >/dev/null 2>&1
+rc=$?
+set -e
+test "$rc" -eq 2
+$BIN --history "$tmp/hist.bin" "$tmp/t" >/dev/null
+
+if $BIN --history "$tmp/missing.bin" "$tmp/t" >/dev/null 2>&1; then exit 1; fi
+if $BIN --schedule random "$tmp/t" >/dev/null 2>&1; then exit 1; fi
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+# Files at every level, and hardlinks between top-level directories (and the
+# root), which different shards count separately.
+mkdir -p "$tmp"/t/{1..20}/{a,b}/c
+printf "12345" > "$tmp/t/top"
+for i in $(seq 1 20); do
+  head -c $((i * 10)) /dev/zero > "$tmp/t/$i/f"
+  head -c $((i * 3)) /dev/zero > "$tmp/t/$i/a/g"
+  head -c 7 /dev/zero > "$tmp/t/$i/b/c/h"
+done
+head -c 1000 /dev/zero > "$tmp/t/1/big"
+ln "$tmp/t/1/big" "$tmp/t/2/a/link"
+ln "$tmp/t/1/big" "$tmp/t/3/b/c/link"
+ln "$tmp/t/1/big" "$tmp/t/biglink"
+roots=("$tmp/t" "$tmp/t/1" "$tmp/t/top")
+expected="$($BIN "${roots[@]}")"
+
+for level in 1 2 3; do
+  for n in 1 2 3 5; do
+    for jobs in 1 4; do
+      files=()
+      for i in $(seq 1 "$n"); do
+        $BIN -j "$jobs" --shard "$i/$n" --shard-level "$level" --shard-out "$tmp/s$i" "${roots[@]}" >/dev/null
+        files+=("$tmp/s$i")
+      done
+      test "$($BIN merge "${files[@]}")" = "$expected"
+    done
+  done
+done
+
+# Roots scanned concurrently and delivered out of order keep their links apart.
+files=()
+for i in 1 2 3; do
+  $BIN -j 4 --unordered --reorder-window 3 --shard "$i/3" --shard-out "$tmp/s$i" "${roots[@]}" >/dev/null
+  files+=("$tmp/s$i")
+done
+test "$($BIN merge "${files[@]}")" = "$expected"
+
+# Roots match by position: a shard may reach the same tree under another path.
+ln -s "$tmp/t" "$tmp/alias"
+$BIN --shard 1/2 --shard-out "$tmp/s1" "${roots[@]}" >/dev/null
+$BIN --shard 2/2 --shard-out "$tmp/s2" "$tmp/alias/." "$tmp/alias/1" "$tmp/alias/top" >/dev/null
+test "$($BIN merge "$tmp/s1" "$tmp/s2")" = "$expected"
+
+# The shards divide the work: each sees less than the whole tree.
+$BIN --shard 1/2 --shard-out "$tmp/s1" "$tmp/t" > "$tmp/p1"
+$BIN --shard 2/2 --shard-out "$tmp/s2" "$tmp/t" > "$tmp/p2"
+whole="$($BIN "$tmp/t" | cut -f1)"
+test "$(cut -f1 "$tmp/p1")" -lt "$whole"
+test "$(cut -f1 "$tmp/p2")" -lt "$whole"
+
+# An incomplete or inconsistent set of shard files is rejected.
+rc=0; $BIN merge "$tmp/s1" 2>/dev/null || rc=$?
+test "$rc" -eq 2
+rc=0; $BIN merge "$tmp/s1" "$tmp/s1" 2>/dev/null || rc=$?
+test "$rc" -eq 2
+$BIN --shard 2/2 --shard-out "$tmp/other" "$tmp/t" "$tmp/t/1" >/dev/null
+rc=0; $BIN merge "$tmp/s1" "$tmp/other" 2>/dev/null || rc=$?
+test "$rc" -eq 2
+
+rc=0; $BIN --shard 1/2 "$tmp/t" 2>/dev/null || rc=$?
+test "$rc" -eq 2
+rc=0; $BIN --shard 3/2 --shard-out "$tmp/x" "$tmp/t" 2>/dev/null || rc=$?
+test "$rc" -eq 2
+rc=0; $BIN --shard 1/2 --shard-out "$tmp/x" --group-by uid "$tmp/t" 2>/dev/null || rc=$?
+test "$rc" -eq 2
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+# One flat directory with files, subdirectories and hardlinks spread across chunks.
+mkdir -p "$tmp/flat"
+for i in $(seq 1 3000); do printf "x" > "$tmp/flat/f$i"; done
+for i in $(seq 1 40); do
+  mkdir -p "$tmp/flat/d$i"
+  printf "abc" > "$tmp/flat/d$i/x"
+  ln "$tmp/flat/d$i/x" "$tmp/flat/l$i"
+done
+
+expected="$(printf '3120\t%s' "$tmp/flat")"
+test "$($BIN "$tmp/flat")" = "$expected"
+
+for split in 1 100 0; do
+  test "$($BIN -j 4 --split-dir "$split" "$tmp/flat")" = "$expected"
+  test "$($BIN -j 4 --split-dir "$split" --max-queue 1 "$tmp/flat")" = "$expected"
+done
+
+# Chunks are handed to the pool, and the manifest matches a sequential scan.
+$BIN -j 4 --split-dir 100 --debug-threads "$tmp/flat" >/dev/null 2>"$tmp/err"
+grep -q "split-dir path=$tmp/flat" "$tmp/err"
+$BIN -j 4 --split-dir 100 --manifest "$tmp/m-split" "$tmp/flat" >/dev/null
+$BIN --manifest "$tmp/m-seq" "$tmp/flat" >/dev/null
+test -z "$($BIN diff "$tmp/m-split" "$tmp/m-seq")"
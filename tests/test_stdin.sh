@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+BIN="./du-sync"
+
+tmp="$(mktemp -d)"
+trap 'chmod -R u+rwX "$tmp" >/dev/null 2>&1 || true; rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/d"
+printf "hello" > "$tmp/d/a"
+printf "abc" > "$tmp/d/b c"   # space in name
+
+expected="$(printf '5\t%s\n3\t%s\n' "$tmp/d/a" "$tmp/d/b c")"
+
+# Pipe (block reader), with and without trailing delimiter, empty entries skipped.
+test "$(printf '%s\n\n%s\n' "$tmp/d/a" "$tmp/d/b c" | $BIN)" = "$expected"
+test "$(printf '%s\n%s' "$tmp/d/a" "$tmp/d/b c" | $BIN -)" = "$expected"
+test "$(printf '%s\0%s\0' "$tmp/d/a" "$tmp/d/b c" | $BIN -0 -)" = "$expected"
+
+# Regular file on stdin (mmap'd).
+printf '%s\0%s' "$tmp/d/a" "$tmp/d/b c" > "$tmp/list0"
+test "$($BIN -0 - < "$tmp/list0")" = "$expected"
+printf '%s\n%s\n' "$tmp/d/a" "$tmp/d/b c" > "$tmp/list"
+test "$($BIN < "$tmp/list")" = "$expected"
+
+# Enough paths to span several read blocks; every path must come back intact.
+for i in $(seq 1 40000); do printf '%s/d/%0200d\n' "$tmp" "$i"; done > "$tmp/many"
+test "$(cat "$tmp/many" | $BIN -q | awk -F'\t' '{print $2}' | cmp - "$tmp/many" && echo same)" = "same"
+test "$($BIN -q < "$tmp/many" | wc -l)" = "40000"